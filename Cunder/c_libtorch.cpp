@@ -1,8 +1,59 @@
 #include <torch/all.h>
 #include <torch/script.h>
 #include <c10/core/alignment.h>
+#include <caffe2/serialize/read_adapter_interface.h>
+#include <torch/csrc/autograd/profiler_legacy.h>
+#include <torch/csrc/jit/ir/constants.h>
+#include <torch/csrc/jit/passes/constant_pooling.h>
+#include <torch/csrc/jit/passes/dead_code_elimination.h>
+#include <torch/csrc/jit/runtime/graph_executor.h>
+#include <ATen/ScalarOps.h>
+#include <ATen/core/dispatch/Dispatcher.h>
 #include "c_libtorch.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CUNDER_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // POSIX
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#endif // __linux__
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CUNDER_SSE2
+#include <emmintrin.h>
+#endif // SSE2
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif // NOMINMAX
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif // WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif // _WIN32
+
 namespace cunder
 {
 	inline static bool
@@ -46,6 +97,12 @@ namespace cunder
 		case Cunder_Float64:
 			return torch::kFloat64;
 
+		case Cunder_Float16:
+			return torch::kFloat16;
+
+		case Cunder_BFloat16:
+			return torch::kBFloat16;
+
 		case Cunder_Invalid:
 		default:
 			throw std::invalid_argument("Unknown dtype");
@@ -82,435 +139,4327 @@ namespace cunder
 		case torch::kFloat64:
 			return Cunder_Float64;
 
+		case torch::kFloat16:
+			return Cunder_Float16;
+
+		case torch::kBFloat16:
+			return Cunder_BFloat16;
+
 		default:
 			return Cunder_Invalid;
 		}
 	}
 
+	// Element size in bytes.
 	constexpr int
 	get_dtype_size(Cunder_DType dtype)
 	{
 		switch (dtype)
 		{
 		case Cunder_Bool:
-			return 1;
-
 		case Cunder_Uint8:
 		case Cunder_Int8:
-			return 8;
+			return 1;
 
 		case Cunder_Int16:
-			return 16;
+		case Cunder_Float16:
+		case Cunder_BFloat16:
+			return 2;
 
 		case Cunder_Int32:
 		case Cunder_Float32:
-			return 32;
+			return 4;
 
 		case Cunder_Int64:
 		case Cunder_Float64:
-			return 64;
+			return 8;
 
 		case Cunder_Invalid:
 		default:
 			return 0;
 		}
 	}
-} // namespace cunder
 
-extern "C"
-{
-
-	// definitions
-	struct Cunder_Tensor
+	// Slab allocator for the tensor handles and handle arrays (size classes of 1, 2, 4, 8 and 16 handles).
+	// Blocks are served from per thread freelists, refilled from and flushed to a central freelist in batches,
+	// slabs are never returned to the system so the hot path does not touch the global heap.
+	class handle_slabs
 	{
-		torch::Tensor tensor;
-	};
+	public:
+		static void *
+		allocate(size_t slots)
+		{
+			int size_class = _size_class(slots);
+			if (size_class < 0)
+				return malloc(slots * handle_bytes);
 
-	struct Cunder_Module
-	{
-		torch::jit::Module module;
-	};
+			thread_cache &local = _local();
+			if (local.heads[size_class] == nullptr)
+				_refill(local, size_class);
 
-	struct Cunder_Allocator final : at::Allocator
-	{
-		std::function<void *(size_t, uint8_t)> aligned_allocator;
-		at::DeleterFnPtr deleter;
+			free_block *block = local.heads[size_class];
+			local.heads[size_class] = block->next;
+			--local.counts[size_class];
+			return block;
+		}
 
-		Cunder_Allocator() {}
-		~Cunder_Allocator() override {}
+		static void
+		deallocate(void *pointer, size_t slots)
+		{
+			int size_class = _size_class(slots);
+			if (size_class < 0)
+			{
+				free(pointer);
+				return;
+			}
 
-		Cunder_Allocator(void *(*allocate)(size_t, uint8_t), void (*deallocate)(void *))
+			thread_cache &local = _local();
+			free_block *block = (free_block *)pointer;
+			block->next = local.heads[size_class];
+			local.heads[size_class] = block;
+			if (++local.counts[size_class] > 2 * batch_blocks)
+				_flush(local, size_class, batch_blocks);
+		}
+
+	private:
+		static constexpr size_t handle_bytes = sizeof(torch::Tensor);
+		static constexpr int classes_count = 5;
+		static constexpr size_t slab_blocks = 64;
+		static constexpr size_t batch_blocks = 32;
+
+		struct free_block
 		{
-			aligned_allocator = allocate;
-			deleter = deallocate;
+			free_block *next;
+		};
+
+		struct central_list
+		{
+			std::mutex mutex;
+			free_block *head = nullptr;
+		};
+
+		struct thread_cache
+		{
+			free_block *heads[classes_count] = {};
+			size_t counts[classes_count] = {};
+
+			~thread_cache()
+			{
+				for (int size_class = 0; size_class < classes_count; ++size_class)
+					_flush(*this, size_class, counts[size_class]);
+			}
+		};
+
+		static int
+		_size_class(size_t slots)
+		{
+			int size_class = 0;
+			for (size_t class_slots = 1; size_class < classes_count; ++size_class, class_slots <<= 1)
+				if (slots <= class_slots)
+					return size_class;
+			return -1;
 		}
 
-		at::DataPtr
-		allocate(size_t nbytes) const override
+		// leaked on purpose, blocks may be freed by thread caches during the process exit
+		static central_list &
+		_central(int size_class)
 		{
-			if (nbytes <= 0)
-				return {nullptr, nullptr, deleter, at::Device(at::DeviceType::CPU)};
-			void *data = aligned_allocator(nbytes, c10::gAlignment);
-			return {data, data, deleter, at::Device(at::DeviceType::CPU)};
+			static central_list *lists = new central_list[classes_count];
+			return lists[size_class];
 		}
-		at::DeleterFnPtr
-		raw_deleter() const override
+
+		static thread_cache &
+		_local()
+		{
+			thread_local thread_cache cache;
+			return cache;
+		}
+
+		static void
+		_refill(thread_cache &local, int size_class)
+		{
+			central_list &central = _central(size_class);
+			std::lock_guard<std::mutex> lock(central.mutex);
+			if (central.head == nullptr)
+			{
+				size_t block_bytes = handle_bytes << size_class;
+				char *slab = (char *)malloc(block_bytes * slab_blocks);
+				if (slab == nullptr)
+					throw std::bad_alloc();
+				for (size_t i = 0; i < slab_blocks; ++i)
+				{
+					free_block *block = (free_block *)(slab + i * block_bytes);
+					block->next = central.head;
+					central.head = block;
+				}
+			}
+
+			for (size_t moved = 0; moved < batch_blocks && central.head != nullptr; ++moved)
+			{
+				free_block *block = central.head;
+				central.head = block->next;
+				block->next = local.heads[size_class];
+				local.heads[size_class] = block;
+				++local.counts[size_class];
+			}
+		}
+
+		static void
+		_flush(thread_cache &local, int size_class, size_t count)
 		{
-			return deleter;
+			if (count == 0)
+				return;
+
+			central_list &central = _central(size_class);
+			std::lock_guard<std::mutex> lock(central.mutex);
+			for (; count > 0 && local.heads[size_class] != nullptr; --count)
+			{
+				free_block *block = local.heads[size_class];
+				local.heads[size_class] = block->next;
+				--local.counts[size_class];
+				block->next = central.head;
+				central.head = block;
+			}
 		}
 	};
 
-	Cunder_Allocator *
-	cunder_set_cpu_allocator(void *(*allocate)(size_t, uint8_t), void (*deallocate)(void *))
+	// Message of the last failed module load on the calling thread.
+	inline static std::string &
+	last_error()
 	{
-		auto allocator = (Cunder_Allocator *)malloc(sizeof(Cunder_Allocator));
-		::new (allocator) Cunder_Allocator(std::forward<void *(*)(size_t, uint8_t)>(allocate), std::forward<c10::DeleterFnPtr>(deallocate));
-		torch::SetAllocator(c10::DeviceType::CPU, allocator);
-		return allocator;
+		thread_local std::string message;
+		return message;
 	}
 
-	void
-	cunder_allocator_free(Cunder_Allocator *allocator)
+	// Read only memory mapping of a whole file, unmapped on destruction.
+	class mapped_file
 	{
-		free(allocator);
-	}
+	public:
+		mapped_file() = default;
+		mapped_file(const mapped_file &) = delete;
+		mapped_file &
+		operator=(const mapped_file &) = delete;
 
-	Torch_Version
-	cunder_torch_version()
-	{
-		return Torch_Version{TORCH_VERSION_MAJOR, TORCH_VERSION_MINOR, TORCH_VERSION_PATCH};
-	}
+		~mapped_file()
+		{
+#ifdef CUNDER_POSIX
+			if (data != nullptr)
+				munmap(data, size);
+#elif defined(_WIN32)
+			if (data != nullptr)
+				UnmapViewOfFile(data);
+#endif
+		}
 
-	Cunder_Array
-	cunder_tensor_allocate(size_t tensors_count)
-	{
-		Cunder_Tensor *tensors = (Cunder_Tensor *)malloc(sizeof(Cunder_Tensor) * tensors_count);
-		for (size_t i = 0; i < tensors_count; ++i)
-			::new (&tensors[i]) Cunder_Tensor{torch::Tensor()};
-		return Cunder_Array{tensors, tensors_count};
-	}
+		// `copy_on_write` maps the pages writable, writes stay private to the process.
+		bool
+		open(const char *filename, bool copy_on_write)
+		{
+#ifdef CUNDER_POSIX
+			int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+				return false;
+			struct stat file_stat;
+			if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+			{
+				::close(fd);
+				return false;
+			}
+			size = (size_t)file_stat.st_size;
+			void *region = mmap(nullptr, size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (region == MAP_FAILED)
+				return false;
+			data = region;
+			return true;
+#elif defined(_WIN32)
+			HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return false;
+			LARGE_INTEGER file_size;
+			if (GetFileSizeEx(file, &file_size) == FALSE || file_size.QuadPart == 0)
+			{
+				CloseHandle(file);
+				return false;
+			}
+			size = (size_t)file_size.QuadPart;
+			HANDLE mapping = CreateFileMappingA(file, nullptr, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+			CloseHandle(file);
+			if (mapping == nullptr)
+				return false;
+			data = MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+			return data != nullptr;
+#else
+			(void)filename;
+			(void)copy_on_write;
+			return false;
+#endif
+		}
 
-	void
-	cunder_tensor_array_set(Cunder_Array tensors_array, size_t i, Cunder_Tensor *tensor)
-	{
-		tensors_array.data[i].tensor.~Tensor();
-		tensors_array.data[i] = std::move(*tensor);
-	}
+		void *data = nullptr;
+		size_t size = 0;
+	};
 
-	Cunder_Tensor *
-	cunder_tensor_array_get(Cunder_Array tensors_array, size_t i)
+	// Tensor file: a 64 bytes header, the raw tensors data at 64 bytes aligned offsets, then the index.
+	// An index entry is: u32 name length, name, i32 dtype, i32 ndim, i64 shape[ndim], u64 data offset, u64 data bytes.
+	struct tensor_file_header
 	{
-		if (i > tensors_array.length)
-			return nullptr;
-		return &tensors_array.data[i];
-	}
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order; // tensor_file_byte_order in the writer order, the data is in native order
+		uint64_t tensors_count;
+		uint64_t index_offset;
+		uint64_t index_bytes;
+		uint8_t reserved[24];
+	};
+	static_assert(sizeof(tensor_file_header) == 64, "tensor file header must be 64 bytes");
 
-	Cunder_Tensor *
-	cunder_tensor_clone(Cunder_Tensor *src)
-	{
-		if (src == nullptr)
-			return nullptr;
+	constexpr char tensor_file_magic[8] = {'C', 'U', 'N', 'D', 'E', 'R', 'T', '\0'};
+	constexpr uint32_t tensor_file_version = 1;
+	constexpr uint32_t tensor_file_byte_order = 0x01020304;
+	constexpr size_t tensor_file_alignment = 64;
 
-		auto out = new Cunder_Tensor{src->tensor.clone()};
-		return out;
+	template <typename T>
+	inline static void
+	append_pod(std::string &out, const T &value)
+	{
+		out.append((const char *)&value, sizeof(T));
 	}
 
-	void
-	cunder_tensor_clone_allocated(void *out_void, void *src_void)
+	// Bounds checked reads over a memory range.
+	struct memory_reader
 	{
-		Cunder_Tensor *src = (Cunder_Tensor *)src_void;
-		Cunder_Tensor *out = (Cunder_Tensor *)out_void;
-		if (src == nullptr)
-			return;
+		const char *cursor;
+		const char *end;
 
-		if (out->tensor.getIntrusivePtr() == nullptr)
-			out->tensor.unsafeReleaseTensorImpl();
-		out->tensor = src->tensor.clone();
-	}
+		bool
+		read(void *out, size_t n)
+		{
+			if ((size_t)(end - cursor) < n)
+				return false;
+			memcpy(out, cursor, n);
+			cursor += n;
+			return true;
+		}
+	};
 
-	int
-	cunder_tensor_free(Cunder_Tensor *self)
+	// Serves the TorchScript archive reader straight from memory, without a stream in between.
+	class memory_read_adapter final : public caffe2::serialize::ReadAdapterInterface
 	{
-		if (self == nullptr)
-			return -1;
+	public:
+		memory_read_adapter(const void *data, size_t size, std::shared_ptr<mapped_file> mapping = nullptr)
+			: data((const char *)data), data_size(size), mapping(std::move(mapping))
+		{
+		}
 
-		self->tensor.~Tensor();
-		free(self);
+		size_t
+		size() const override
+		{
+			return data_size;
+		}
 
-		return 0; // success
-	}
+		size_t
+		read(uint64_t pos, void *buf, size_t n, const char *what = "") const override
+		{
+			(void)what;
+			if (pos >= data_size)
+				return 0;
+			n = std::min(n, data_size - (size_t)pos);
+			memcpy(buf, data + pos, n);
+			return n;
+		}
 
-	int
-	cunder_module_free(Cunder_Module *self)
+	private:
+		const char *data;
+		size_t data_size;
+		std::shared_ptr<mapped_file> mapping;
+	};
+
+	// Allocation counters of a Cunder_Allocator, updated with relaxed atomics on every allocation and free.
+	struct allocation_stats
 	{
-		if (self == nullptr)
-			return -1;
+		std::atomic<int64_t> current_bytes{0};
+		std::atomic<int64_t> peak_bytes{0};
+		std::atomic<int64_t> scope_peak_bytes{0};
+		std::atomic<int64_t> allocations_count{0};
+		std::atomic<int64_t> deallocations_count{0};
+		std::atomic<int64_t> histogram[CUNDER_ALLOCATOR_HISTOGRAM_BINS] = {};
 
-		self->module.~Module();
-		free(self);
+		static int
+		histogram_bin(size_t nbytes)
+		{
+			int bin = 0;
+			for (size_t value = nbytes; value > 1 && bin < CUNDER_ALLOCATOR_HISTOGRAM_BINS - 1; value >>= 1)
+				++bin;
+			return bin;
+		}
 
-		return 0; // success
-	}
+		static void
+		update_max(std::atomic<int64_t> &target, int64_t value)
+		{
+			int64_t current = target.load(std::memory_order_relaxed);
+			while (value > current && target.compare_exchange_weak(current, value, std::memory_order_relaxed) == false)
+			{
+			}
+		}
 
-	int
-	cunder_array_free(Cunder_Array self)
-	{
-		if (self.data == nullptr)
-			return -1;
+		void
+		on_allocate(size_t nbytes)
+		{
+			int64_t current = current_bytes.fetch_add((int64_t)nbytes, std::memory_order_relaxed) + (int64_t)nbytes;
+			update_max(peak_bytes, current);
+			update_max(scope_peak_bytes, current);
+			allocations_count.fetch_add(1, std::memory_order_relaxed);
+			histogram[histogram_bin(nbytes)].fetch_add(1, std::memory_order_relaxed);
+		}
 
-		for (size_t i = 0; i < self.length; ++i)
-			self.data[i].tensor.~Tensor();
-		cunder_tensor_free(self.data);
-		return 0; // success
-	}
+		void
+		on_free(size_t nbytes)
+		{
+			current_bytes.fetch_sub((int64_t)nbytes, std::memory_order_relaxed);
+			deallocations_count.fetch_add(1, std::memory_order_relaxed);
+		}
+	};
 
-	inline static bool
-	_cunder_check_initialization_param(int ndim, const int *shape, Cunder_DType dtype)
+	// Size classes of the caching allocator, 4 classes per power of two starting at 64 bytes (at most 25% waste).
+	constexpr int
+	caching_size_class(size_t nbytes)
 	{
-		if (ndim < 1 || ndim > 3 || shape == nullptr || cunder::is_valid_dtype(dtype) == false)
-			return false;
-		return true;
+		if (nbytes <= 64)
+			return 0;
+
+		int k = 0;
+		for (size_t value = nbytes - 1; value > 1; value >>= 1)
+			++k;
+		int sub = (int)(((nbytes - 1) >> (k - 2)) & 3);
+		return (k - 6) * 4 + sub + 1;
 	}
 
-	Cunder_Tensor *
-	cunder_tensor_ones(int ndim, const int *shape, Cunder_DType dtype)
+	constexpr size_t
+	caching_class_bytes(int size_class)
 	{
-		if (_cunder_check_initialization_param(ndim, shape, dtype) == false)
-			return nullptr;
+		if (size_class == 0)
+			return 64;
 
-		std::vector<int64_t> vshape(shape, shape + ndim);
-		Cunder_Tensor *tensor = new Cunder_Tensor{torch::ones(vshape, cunder::get_libtorch_dtype(dtype))};
-		return tensor;
+		int k = 6 + (size_class - 1) / 4;
+		int sub = (size_class - 1) % 4;
+		return ((size_t)1 << k) + (size_t)(sub + 1) * ((size_t)1 << (k - 2));
 	}
 
-	Cunder_Tensor *
-	cunder_tensor_zeros(int ndim, const int *shape, Cunder_DType dtype)
+	// Caching CPU allocator, freed blocks are kept in size class freelists (optionally per thread first)
+	// and reused by the next allocation of the same class, up to `max_cached_bytes` of idle memory.
+	class caching_allocator : public std::enable_shared_from_this<caching_allocator>
 	{
-		if (_cunder_check_initialization_param(ndim, shape, dtype) == false)
-			return nullptr;
+	public:
+		// placed in front of every block, the DataPtr context points to it
+		struct block_header
+		{
+			caching_allocator *owner;
+			int size_class;
+			size_t block_bytes;
+			size_t requested_bytes;
+			size_t mapped_bytes; // 0 when the block is not mmapped
+		};
 
-		std::vector<int64_t> vshape(shape, shape + ndim);
-		Cunder_Tensor *tensor = new Cunder_Tensor{torch::zeros(vshape, cunder::get_libtorch_dtype(dtype))};
-		return tensor;
-	}
+		static constexpr size_t header_bytes = 64;
+		static constexpr int classes_count = 169; // up to 2^48 bytes
+		static constexpr size_t thread_cache_max_block = 32 * 1024;
+		static constexpr int thread_classes = caching_size_class(thread_cache_max_block) + 1;
+		static constexpr size_t mmap_threshold = 1024 * 1024;
+		static constexpr size_t hugepage_bytes = 2 * 1024 * 1024;
 
-	Cunder_Tensor *
-	cunder_tensor_eye(int n, Cunder_DType dtype)
-	{
-		if (cunder::is_valid_dtype(dtype) == false)
-			return nullptr;
+		// `on_release(release_context)` is called last whenever a block is freed, after which the allocator may be gone
+		caching_allocator(
+			const Cunder_CachingAllocatorConfig &config,
+			std::shared_ptr<allocation_stats> stats,
+			void (*on_release)(const void *) = nullptr,
+			const void *release_context = nullptr)
+			: config(config), stats(std::move(stats)), on_release(on_release), release_context(release_context), classes(classes_count)
+		{
+		}
 
-		auto *tensor = new Cunder_Tensor{torch::eye(n, cunder::get_libtorch_dtype(dtype))};
-		return tensor;
-	}
+		~caching_allocator()
+		{
+			empty_cache();
+		}
 
-	Cunder_Tensor *
-	cunder_tensor_range(int start, int end, int step, Cunder_DType dtype)
-	{
-		if (cunder::is_valid_dtype(dtype) == false)
-			return nullptr;
+		// Returns the header of a block able to hold `nbytes`, nullptr on failure.
+		block_header *
+		allocate(size_t nbytes)
+		{
+			block_header *header = _allocate(nbytes);
+			if (header != nullptr)
+			{
+				header->requested_bytes = nbytes;
+				stats->on_allocate(nbytes);
+			}
+			return header;
+		}
 
-		auto *tensor = new Cunder_Tensor{torch::range(start, end, step, cunder::get_libtorch_dtype(dtype))};
-		return tensor;
-	}
+		void
+		deallocate(block_header *header)
+		{
+			stats->on_free(header->requested_bytes);
+			_cache(header);
+		}
 
-	Cunder_Tensor *
-	cunder_tensor_from_data(int ndim, const int *shape, void *data, Cunder_DType dtype)
-	{
-		if (_cunder_check_initialization_param(ndim, shape, dtype) == false)
-			return nullptr;
+		// Release every idle block held by the central freelists.
+		void
+		empty_cache()
+		{
+			for (class_list &list : classes)
+			{
+				std::lock_guard<std::mutex> lock(list.mutex);
+				for (block_header *header : list.blocks)
+				{
+					cached_bytes -= header->block_bytes;
+					_system_free(header);
+				}
+				list.blocks.clear();
+			}
+		}
 
-		Cunder_Tensor *tensor = new Cunder_Tensor{};
-		std::vector<int64_t> vshape(shape, shape + ndim);
-		tensor->tensor = torch::from_blob(data, vshape, torch::TensorOptions(cunder::get_libtorch_dtype(dtype)));
-		return tensor;
-	}
+		// Return the blocks cached by the calling thread to the central freelists, the caches of the other threads
+		// are returned when those threads exit.
+		void
+		flush_thread_cache()
+		{
+			thread_cache &local = _local();
+			if (local.owner.get() == this)
+				local.flush();
+		}
 
-	void
-	cunder_tensor_to(Cunder_Tensor *tensor, Cunder_DType dtype)
-	{
-		if (tensor == nullptr)
-			return;
-		tensor->tensor = tensor->tensor.toType(cunder::get_libtorch_dtype(dtype));
-	}
+		// Idle bytes held by the central freelists.
+		size_t
+		idle_bytes() const
+		{
+			return cached_bytes.load();
+		}
 
-	void
-	cunder_tensor_print(const Cunder_Tensor *tensor)
-	{
-		if (tensor == nullptr)
-			return;
-		print(tensor->tensor);
-		printf("\n");
-	}
+		static void *
+		data(block_header *header)
+		{
+			return (char *)header + header_bytes;
+		}
 
-	Cunder_DType
-	cunder_tensor_type(const Cunder_Tensor *tensor)
-	{
-		return cunder::get_cunder_dtype(tensor->tensor.scalar_type());
-	}
+		static void
+		release(void *context)
+		{
+			block_header *header = (block_header *)context;
+			caching_allocator *owner = header->owner;
+			void (*on_release)(const void *) = owner->on_release;
+			const void *release_context = owner->release_context;
+			owner->deallocate(header);
+			if (on_release != nullptr)
+				on_release(release_context);
+		}
 
-	int64_t
-	cunder_tensor_ndim(const Cunder_Tensor *tensor)
-	{
-		return tensor->tensor.dim();
-	}
+	private:
+		block_header *
+		_allocate(size_t nbytes)
+		{
+			int size_class = caching_size_class(nbytes);
+			if (size_class >= classes_count)
+				return nullptr;
 
-	void
-	cunder_tensor_shape(const Cunder_Tensor *tensor, int64_t *out_shape)
-	{
-		int d = 0;
-		for (int64_t size : tensor->tensor.sizes())
-			out_shape[d++] = size;
-	}
+			if (config.per_thread_cache && size_class < thread_classes)
+			{
+				thread_cache &local = _local();
+				if (local.owner.get() != this)
+				{
+					local.flush();
+					local.owner = shared_from_this();
+				}
+				std::vector<block_header *> &blocks = local.blocks[size_class];
+				if (blocks.empty() == false)
+				{
+					block_header *header = blocks.back();
+					blocks.pop_back();
+					local.bytes -= header->block_bytes;
+					return header;
+				}
+			}
 
-	int64_t
-	cunder_tensor_numel(const Cunder_Tensor *tensor)
+			{
+				class_list &list = classes[size_class];
+				std::lock_guard<std::mutex> lock(list.mutex);
+				if (list.blocks.empty() == false)
+				{
+					block_header *header = list.blocks.back();
+					list.blocks.pop_back();
+					cached_bytes -= header->block_bytes;
+					return header;
+				}
+			}
+			return _system_allocate(size_class);
+		}
+
+		void
+		_cache(block_header *header)
+		{
+			if (config.per_thread_cache && header->size_class < thread_classes)
+			{
+				thread_cache &local = _local();
+				if (local.owner.get() == this && local.bytes + header->block_bytes <= config.thread_cache_bytes)
+				{
+					local.blocks[header->size_class].push_back(header);
+					local.bytes += header->block_bytes;
+					return;
+				}
+			}
+			_central_release(header);
+		}
+
+		struct class_list
+		{
+			std::mutex mutex;
+			std::vector<block_header *> blocks;
+		};
+
+		struct thread_cache
+		{
+			std::shared_ptr<caching_allocator> owner;
+			std::vector<block_header *> blocks[thread_classes];
+			size_t bytes = 0;
+
+			~thread_cache()
+			{
+				flush();
+			}
+
+			void
+			flush()
+			{
+				if (owner == nullptr)
+					return;
+				for (std::vector<block_header *> &class_blocks : blocks)
+				{
+					for (block_header *header : class_blocks)
+						owner->_central_release(header);
+					class_blocks.clear();
+				}
+				bytes = 0;
+				owner.reset();
+			}
+		};
+
+		static thread_cache &
+		_local()
+		{
+			thread_local thread_cache cache;
+			return cache;
+		}
+
+		void
+		_central_release(block_header *header)
+		{
+			if (config.max_cached_bytes == 0 || cached_bytes.load() + header->block_bytes <= config.max_cached_bytes)
+			{
+				class_list &list = classes[header->size_class];
+				std::lock_guard<std::mutex> lock(list.mutex);
+				list.blocks.push_back(header);
+				cached_bytes += header->block_bytes;
+				return;
+			}
+			_system_free(header);
+		}
+
+		block_header *
+		_system_allocate(int size_class)
+		{
+			size_t block_bytes = caching_class_bytes(size_class);
+			size_t total_bytes = header_bytes + block_bytes;
+			void *base = nullptr;
+			size_t mapped_bytes = 0;
+#ifdef __linux__
+			if (total_bytes >= mmap_threshold)
+			{
+				// huge page backed blocks are 2MB aligned, over map then trim the head and tail
+				size_t page_bytes = (size_t)sysconf(_SC_PAGESIZE);
+				size_t alignment = config.use_hugepages && total_bytes >= hugepage_bytes ? hugepage_bytes : page_bytes;
+				mapped_bytes = (total_bytes + alignment - 1) / alignment * alignment;
+				size_t reserved_bytes = mapped_bytes + (alignment > page_bytes ? alignment : 0);
+				void *region = mmap(nullptr, reserved_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (region == MAP_FAILED)
+					return nullptr;
+				uintptr_t start = ((uintptr_t)region + alignment - 1) / alignment * alignment;
+				size_t head_bytes = start - (uintptr_t)region;
+				size_t tail_bytes = reserved_bytes - head_bytes - mapped_bytes;
+				if (head_bytes > 0)
+					munmap(region, head_bytes);
+				if (tail_bytes > 0)
+					munmap((char *)start + mapped_bytes, tail_bytes);
+				base = (void *)start;
+#ifdef MADV_HUGEPAGE
+				if (alignment == hugepage_bytes)
+					madvise(base, mapped_bytes, MADV_HUGEPAGE);
+#endif // MADV_HUGEPAGE
+			}
+#endif // __linux__
+			if (base == nullptr)
+			{
+				mapped_bytes = 0;
+#ifdef _WIN32
+				base = _aligned_malloc(total_bytes, header_bytes);
+#else
+				if (posix_memalign(&base, header_bytes, total_bytes) != 0)
+					base = nullptr;
+#endif // _WIN32
+				if (base == nullptr)
+					return nullptr;
+			}
+			return ::new (base) block_header{this, size_class, block_bytes, 0, mapped_bytes};
+		}
+
+		static void
+		_system_free(block_header *header)
+		{
+#ifdef __linux__
+			if (header->mapped_bytes > 0)
+			{
+				munmap(header, header->mapped_bytes);
+				return;
+			}
+#endif // __linux__
+#ifdef _WIN32
+			_aligned_free(header);
+#else
+			free(header);
+#endif // _WIN32
+		}
+
+		Cunder_CachingAllocatorConfig config;
+		std::shared_ptr<allocation_stats> stats; // shared with the front end, the thread caches may outlive it
+		void (*on_release)(const void *);
+		const void *release_context;
+		std::vector<class_list> classes;
+		std::atomic<size_t> cached_bytes{0};
+	};
+
+	// Bounded multi-producer multi-consumer ring buffer (Dmitry Vyukov's design), push and pop are lock free.
+	template <typename T>
+	class bounded_queue
+	{
+	public:
+		explicit bounded_queue(size_t capacity)
+		{
+			size_t size = 2;
+			while (size < capacity)
+				size <<= 1;
+			cells.reset(new cell[size]);
+			mask = size - 1;
+			for (size_t i = 0; i < size; ++i)
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			enqueue_pos.store(0, std::memory_order_relaxed);
+			dequeue_pos.store(0, std::memory_order_relaxed);
+		}
+
+		// `value` is only moved from when the push succeeds.
+		bool
+		try_push(T &&value)
+		{
+			cell *target;
+			size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+			while (true)
+			{
+				target = &cells[pos & mask];
+				size_t sequence = target->sequence.load(std::memory_order_acquire);
+				intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+				if (diff == 0)
+				{
+					if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (diff < 0)
+					return false; // full
+				else
+					pos = enqueue_pos.load(std::memory_order_relaxed);
+			}
+			target->value = std::move(value);
+			target->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool
+		try_pop(T &value)
+		{
+			cell *target;
+			size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+			while (true)
+			{
+				target = &cells[pos & mask];
+				size_t sequence = target->sequence.load(std::memory_order_acquire);
+				intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+				if (diff == 0)
+				{
+					if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (diff < 0)
+					return false; // empty
+				else
+					pos = dequeue_pos.load(std::memory_order_relaxed);
+			}
+			value = std::move(target->value);
+			target->value = T();
+			target->sequence.store(pos + mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Approximate element count, exact when no push or pop is in flight.
+		size_t
+		size() const
+		{
+			size_t head = dequeue_pos.load(std::memory_order_seq_cst);
+			size_t tail = enqueue_pos.load(std::memory_order_seq_cst);
+			return tail > head ? tail - head : 0;
+		}
+
+		size_t
+		capacity() const
+		{
+			return mask + 1;
+		}
+
+	private:
+		struct cell
+		{
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		std::unique_ptr<cell[]> cells;
+		size_t mask;
+		alignas(64) std::atomic<size_t> enqueue_pos;
+		alignas(64) std::atomic<size_t> dequeue_pos;
+	};
+
+	// Lock free bounded queue, threads only take the mutex to sleep when the queue is full (push) or empty (pop).
+	template <typename T>
+	class blocking_queue
+	{
+	public:
+		explicit blocking_queue(size_t capacity) : queue(capacity) {}
+
+		// Blocks while the queue is full, returns false once the queue is closed.
+		bool
+		push(T &&value)
+		{
+			while (closed.load(std::memory_order_acquire) == false)
+			{
+				if (queue.try_push(std::move(value)))
+				{
+					_notify(not_empty, sleeping_consumers);
+					return true;
+				}
+				_wait(not_full, sleeping_producers, [this] { return closed.load() || queue.size() < queue.capacity(); });
+			}
+			return false;
+		}
+
+		// Returns false if the queue is full or closed.
+		bool
+		try_push(T &&value)
+		{
+			if (closed.load(std::memory_order_acquire) || queue.try_push(std::move(value)) == false)
+				return false;
+			_notify(not_empty, sleeping_consumers);
+			return true;
+		}
+
+		// Blocks while the queue is empty, returns false once the queue is closed and drained.
+		bool
+		pop(T &value)
+		{
+			while (true)
+			{
+				if (queue.try_pop(value))
+				{
+					_notify(not_full, sleeping_producers);
+					return true;
+				}
+				if (closed.load(std::memory_order_acquire) && queue.size() == 0)
+					return false;
+				_wait(not_empty, sleeping_consumers, [this] { return closed.load() || queue.size() > 0; });
+			}
+		}
+
+		bool
+		try_pop(T &value)
+		{
+			if (queue.try_pop(value) == false)
+				return false;
+			_notify(not_full, sleeping_producers);
+			return true;
+		}
+
+		size_t
+		size() const
+		{
+			return queue.size();
+		}
+
+		// Wake up every waiting thread, pending elements can still be popped.
+		void
+		close()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed.store(true);
+			not_empty.notify_all();
+			not_full.notify_all();
+		}
+
+	private:
+		template <typename Predicate>
+		void
+		_wait(std::condition_variable &condition, std::atomic<int> &sleeping, Predicate ready)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			sleeping.fetch_add(1);
+			condition.wait(lock, ready);
+			sleeping.fetch_sub(1);
+		}
+
+		void
+		_notify(std::condition_variable &condition, std::atomic<int> &sleeping)
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (sleeping.load() == 0)
+				return;
+			std::lock_guard<std::mutex> lock(mutex);
+			condition.notify_one();
+		}
+
+		bounded_queue<T> queue;
+		std::atomic<bool> closed{false};
+		std::atomic<int> sleeping_producers{0};
+		std::atomic<int> sleeping_consumers{0};
+		std::mutex mutex;
+		std::condition_variable not_empty;
+		std::condition_variable not_full;
+	};
+
+	// Installed CPU allocators, every one restores its `previous` allocator once freed.
+	struct allocator_chain
+	{
+		std::mutex mutex;
+		std::vector<Cunder_Allocator *> allocators;
+	};
+
+	// Completion state shared by a Cunder_Future and the worker producing its outputs.
+	struct future_state
+	{
+		std::mutex mutex;
+		std::condition_variable done_condition;
+		std::atomic<bool> done{false};
+		Cunder_Array outputs{nullptr, 0};
+		Cunder_Future *handle = nullptr;
+		Cunder_FutureCallback callback = nullptr;
+		void *callback_data = nullptr;
+		bool callback_running = false; // cunder_future_free() waits for it, the callback gets the handle
+		std::thread::id callback_thread;
+		int event_fd = -1;
+
+		~future_state()
+		{
+			if (outputs.data != nullptr)
+				cunder_array_free(outputs);
+		}
+
+		void
+		complete(Cunder_Array results)
+		{
+			Cunder_Future *on_done_handle = nullptr;
+			Cunder_FutureCallback on_done = nullptr;
+			void *on_done_data = nullptr;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				outputs = results;
+				done.store(true, std::memory_order_release);
+				_signal_event_fd();
+				if (handle != nullptr && callback != nullptr)
+				{
+					on_done_handle = handle;
+					on_done = callback;
+					on_done_data = callback_data;
+					callback_running = true;
+					callback_thread = std::this_thread::get_id();
+				}
+			}
+			done_condition.notify_all();
+			if (on_done == nullptr)
+				return;
+
+			on_done(on_done_handle, on_done_data);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				callback_running = false;
+			}
+			done_condition.notify_all();
+		}
+
+		// must be called with the mutex held
+		void
+		_signal_event_fd()
+		{
+#ifdef __linux__
+			if (event_fd >= 0)
+			{
+				uint64_t one = 1;
+				ssize_t written = write(event_fd, &one, sizeof(one));
+				(void)written;
+			}
+#endif // __linux__
+		}
+	};
+
+	// Pin `thread` to the given cpus, returns false if a cpu is out of range or pinning is unsupported.
+	inline static bool
+	set_thread_affinity(std::thread::native_handle_type thread, const int *cpus, size_t cpus_count)
+	{
+		if (cpus == nullptr || cpus_count == 0)
+			return false;
+#ifdef __linux__
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		for (size_t i = 0; i < cpus_count; ++i)
+		{
+			if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE)
+				return false;
+			CPU_SET(cpus[i], &cpu_set);
+		}
+		return pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set) == 0;
+#elif defined(_WIN32)
+		// a single processor group, up to 64 cpus
+		DWORD_PTR mask = 0;
+		for (size_t i = 0; i < cpus_count; ++i)
+		{
+			if (cpus[i] < 0 || cpus[i] >= (int)(sizeof(DWORD_PTR) * 8))
+				return false;
+			mask |= (DWORD_PTR)1 << cpus[i];
+		}
+		return SetThreadAffinityMask((HANDLE)thread, mask) != 0;
+#else
+		(void)thread;
+		return false;
+#endif
+	}
+
+	inline static bool
+	set_current_thread_affinity(const int *cpus, size_t cpus_count)
+	{
+#ifdef __linux__
+		return set_thread_affinity(pthread_self(), cpus, cpus_count);
+#elif defined(_WIN32)
+		return set_thread_affinity((std::thread::native_handle_type)GetCurrentThread(), cpus, cpus_count);
+#else
+		(void)cpus;
+		(void)cpus_count;
+		return false;
+#endif
+	}
+
+	// Write up to `capacity` cpus the calling thread may run on, returns their count or -1 if unsupported.
+	inline static int
+	get_current_thread_affinity(int *out_cpus, size_t capacity)
+	{
+#ifdef __linux__
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+			return -1;
+		int count = 0;
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if (CPU_ISSET(cpu, &cpu_set) == 0)
+				continue;
+			if ((size_t)count < capacity)
+				out_cpus[count] = cpu;
+			++count;
+		}
+		return count;
+#elif defined(_WIN32)
+		// no getter for the thread mask, swap in the process one and put the previous one back
+		DWORD_PTR process_mask = 0, system_mask = 0;
+		if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask) == FALSE)
+			return -1;
+		DWORD_PTR mask = SetThreadAffinityMask(GetCurrentThread(), process_mask);
+		if (mask == 0)
+			return -1;
+		SetThreadAffinityMask(GetCurrentThread(), mask);
+		int count = 0;
+		for (int cpu = 0; cpu < (int)(sizeof(DWORD_PTR) * 8); ++cpu, mask >>= 1)
+		{
+			if ((mask & 1) == 0)
+				continue;
+			if ((size_t)count < capacity)
+				out_cpus[count] = cpu;
+			++count;
+		}
+		return count;
+#else
+		(void)out_cpus;
+		(void)capacity;
+		return -1;
+#endif
+	}
+
+	// Applies the session options for the lifetime of a forward, the previous grad and optimize modes are restored.
+	struct session_guard
+	{
+		c10::optional<c10::InferenceMode> inference;
+		c10::optional<torch::AutoGradMode> grad_mode;
+		bool previous_optimize;
+
+		explicit session_guard(const Cunder_SessionOptions &options) : previous_optimize(torch::jit::getGraphExecutorOptimize())
+		{
+			if (options.inference_mode)
+				inference.emplace();
+			else
+				grad_mode.emplace(options.grad_enabled);
+			torch::jit::setGraphExecutorOptimize(options.jit_optimize);
+		}
+
+		~session_guard()
+		{
+			torch::jit::setGraphExecutorOptimize(previous_optimize);
+		}
+	};
+
+	// out[i] = in[i] * alpha[i] + beta[i] over a row of interleaved u8 values.
+	inline static void
+	normalize_u8_row(const uint8_t *in, const float *alpha, const float *beta, float *out, int64_t count)
+	{
+		int64_t i = 0;
+#ifdef CUNDER_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= count; i += 16)
+		{
+			// widen 16 bytes to 4 x 4 floats
+			__m128i bytes = _mm_loadu_si128((const __m128i *)(in + i));
+			__m128i low = _mm_unpacklo_epi8(bytes, zero);
+			__m128i high = _mm_unpackhi_epi8(bytes, zero);
+			__m128 values[4] = {
+				_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)),
+				_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)),
+				_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)),
+				_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero))};
+			for (int k = 0; k < 4; ++k)
+			{
+				__m128 result = _mm_add_ps(_mm_mul_ps(values[k], _mm_loadu_ps(alpha + i + 4 * k)), _mm_loadu_ps(beta + i + 4 * k));
+				_mm_storeu_ps(out + i + 4 * k, result);
+			}
+		}
+#endif // CUNDER_SSE2
+		for (; i < count; ++i)
+			out[i] = (float)in[i] * alpha[i] + beta[i];
+	}
+
+	// Convert an u8 HWC image into float CHW (or HWC when `channels_last`), out = in * alpha[c] + beta[c].
+	// Rows are split between the intra-op threads, channels first rows go through a small row buffer so
+	// the image is read and the output written a single time.
+	inline static void
+	normalize_u8_image(
+		const uint8_t *data,
+		int64_t height,
+		int64_t width,
+		int64_t channels,
+		int64_t row_stride,
+		const float *alpha,
+		const float *beta,
+		bool channels_last,
+		float *out)
+	{
+		int64_t row_count = width * channels;
+		std::vector<float> alpha_row(row_count);
+		std::vector<float> beta_row(row_count);
+		for (int64_t i = 0; i < row_count; ++i)
+		{
+			alpha_row[i] = alpha[i % channels];
+			beta_row[i] = beta[i % channels];
+		}
+
+		int64_t plane = height * width;
+		int64_t grain_rows = std::max<int64_t>(1, 32768 / std::max<int64_t>(1, row_count));
+		at::parallel_for(0, height, grain_rows, [&](int64_t begin, int64_t end) {
+			std::vector<float> row;
+			bool transpose = channels_last == false && channels > 1;
+			if (transpose)
+				row.resize(row_count);
+
+			for (int64_t y = begin; y < end; ++y)
+			{
+				const uint8_t *in = data + y * row_stride;
+				if (transpose == false)
+				{
+					normalize_u8_row(in, alpha_row.data(), beta_row.data(), out + y * row_count, row_count);
+					continue;
+				}
+
+				normalize_u8_row(in, alpha_row.data(), beta_row.data(), row.data(), row_count);
+				for (int64_t c = 0; c < channels; ++c)
+				{
+					float *plane_row = out + c * plane + y * width;
+					for (int64_t x = 0; x < width; ++x)
+						plane_row[x] = row[x * channels + c];
+				}
+			}
+		});
+	}
+
+	inline static uint64_t
+	hash_mix(uint64_t x)
+	{
+		x ^= x >> 32;
+		x *= 0xD6E8FEB86659FD93ull;
+		x ^= x >> 32;
+		return x;
+	}
+
+	// 64 bit hash of a byte range (not cryptographic), four independent lanes of 8 bytes per round.
+	inline static uint64_t
+	hash_bytes(const void *data, size_t size, uint64_t seed)
+	{
+		const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+		const unsigned char *bytes = (const unsigned char *)data;
+		uint64_t lanes[4] = {seed, seed + multiplier, seed ^ multiplier, seed - multiplier};
+		size_t i = 0;
+		for (; i + 32 <= size; i += 32)
+		{
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				uint64_t word;
+				memcpy(&word, bytes + i + 8 * lane, sizeof(word));
+				lanes[lane] = (lanes[lane] ^ hash_mix(word)) * multiplier;
+			}
+		}
+		uint64_t hash = size * multiplier;
+		for (uint64_t lane : lanes)
+			hash = (hash ^ hash_mix(lane)) * multiplier;
+		for (; i < size; i += 8)
+		{
+			uint64_t word = 0;
+			memcpy(&word, bytes + i, std::min<size_t>(8, size - i));
+			hash = (hash ^ hash_mix(word)) * multiplier;
+		}
+		return hash_mix(hash);
+	}
+
+	// Parse a sysfs cpu list ("0-3,8,10-11"), returns the cpus count or -1 on a malformed list.
+	inline static int
+	parse_cpu_list(const std::string &list, int *out_cpus, size_t capacity)
+	{
+		int count = 0;
+		const char *cursor = list.c_str();
+		while (*cursor != '\0' && *cursor != '\n')
+		{
+			char *end = nullptr;
+			long first = strtol(cursor, &end, 10);
+			if (end == cursor || first < 0)
+				return -1;
+			long last = first;
+			cursor = end;
+			if (*cursor == '-')
+			{
+				last = strtol(cursor + 1, &end, 10);
+				if (end == cursor + 1 || last < first)
+					return -1;
+				cursor = end;
+			}
+			for (long cpu = first; cpu <= last; ++cpu, ++count)
+				if ((size_t)count < capacity)
+					out_cpus[count] = (int)cpu;
+			if (*cursor == ',')
+				++cursor;
+		}
+		return count;
+	}
+} // namespace cunder
+
+extern "C"
+{
+
+	// definitions
+	struct Cunder_Tensor
+	{
+		torch::Tensor tensor;
+	};
+
+	struct Cunder_Module
+	{
+		torch::jit::Module module;
+	};
+
+	struct Cunder_OutputBindings
+	{
+		struct binding
+		{
+			torch::Tensor buffer; // flat view over the caller memory
+			std::vector<int64_t> shape; // shape of the last written output
+			bool written = false;
+		};
+
+		std::vector<binding> outputs;
+	};
+
+	struct Cunder_Profiler
+	{
+		struct op
+		{
+			std::string name;
+			int64_t calls_count = 0;
+			double cpu_time_us = 0;
+			double self_cpu_time_us = 0;
+			int64_t cpu_memory_bytes = 0;
+		};
+
+		bool running = false;
+		torch::autograd::profiler::thread_event_lists events;
+		std::vector<op> ops; // sorted by self cpu time
+	};
+
+	struct Cunder_Session
+	{
+		Cunder_SessionOptions options;
+	};
+
+	struct Cunder_ResultCache
+	{
+		struct entry
+		{
+			uint64_t key;
+			std::vector<torch::Tensor> inputs; // contiguous copies, compared on lookup to rule out collisions
+			std::vector<torch::Tensor> outputs;
+			size_t nbytes;
+		};
+
+		Cunder_Module *cunder_module;
+		size_t max_bytes;
+		std::mutex mutex;
+		std::list<entry> entries; // most recently used first
+		std::unordered_map<uint64_t, std::list<entry>::iterator> index;
+		size_t nbytes = 0;
+		int64_t hits = 0;
+		int64_t misses = 0;
+		int64_t evictions = 0;
+	};
+
+	struct Cunder_ModelRegistry
+	{
+		struct entry
+		{
+			std::string filename;
+			Cunder_Module *cunder_module = nullptr;
+			bool loading = false;
+			int64_t references_count = 0;
+			uint64_t last_use = 0;
+			int64_t footprint_bytes = 0;
+		};
+
+		size_t memory_budget_bytes;
+		std::mutex mutex;
+		std::condition_variable loaded;
+		std::map<std::pair<std::string, int64_t>, entry> models; // by name then version
+		uint64_t clock = 0;
+		int64_t resident_bytes = 0;
+		int64_t loads_count = 0;
+		int64_t evictions_count = 0;
+
+		~Cunder_ModelRegistry()
+		{
+			for (auto &model : models)
+				delete model.second.cunder_module;
+		}
+	};
+
+	struct Cunder_TensorFile
+	{
+		struct item
+		{
+			std::string name;
+			Cunder_DType dtype;
+			std::vector<int64_t> shape;
+			uint64_t offset;
+		};
+
+		std::shared_ptr<cunder::mapped_file> mapping; // shared with every tensor view
+		std::vector<item> tensors;
+	};
+
+	struct Cunder_Future
+	{
+		std::shared_ptr<cunder::future_state> state;
+	};
+
+	struct Cunder_ModulePool
+	{
+		Cunder_Module *cunder_module;
+		cunder::blocking_queue<std::function<void()>> jobs;
+		std::vector<std::thread> workers;
+
+		Cunder_ModulePool(Cunder_Module *cunder_module, size_t workers_count, size_t queue_capacity)
+			: cunder_module(cunder_module), jobs(queue_capacity)
+		{
+			workers.reserve(workers_count);
+			for (size_t i = 0; i < workers_count; ++i)
+			{
+				workers.emplace_back([this] {
+					current() = this;
+					std::function<void()> job;
+					while (jobs.pop(job))
+					{
+						job();
+						job = nullptr;
+					}
+				});
+			}
+		}
+
+		// the pool whose worker runs on this thread, nullptr outside of the workers
+		static const Cunder_ModulePool *&
+		current()
+		{
+			thread_local const Cunder_ModulePool *pool = nullptr;
+			return pool;
+		}
+
+		// pending jobs are drained before the workers exit
+		~Cunder_ModulePool()
+		{
+			jobs.close();
+			for (std::thread &worker : workers)
+				worker.join();
+		}
+	};
+
+	// Three stages, each on its own thread, connected by bounded queues: preprocess, forward and postprocess.
+	struct Cunder_Pipeline
+	{
+		struct job
+		{
+			void *request = nullptr;
+			Cunder_Array tensors{nullptr, 0}; // inputs then outputs, empty once a stage failed
+		};
+
+		Cunder_Module *cunder_module;
+		Cunder_PreprocessCallback preprocess;
+		Cunder_PostprocessCallback postprocess;
+		void *user_data;
+		cunder::blocking_queue<void *> requests;
+		cunder::blocking_queue<job> inputs;
+		cunder::blocking_queue<job> outputs;
+		std::atomic<int64_t> submitted_count{0};
+		std::atomic<int64_t> completed_count{0};
+		std::mutex flush_mutex;
+		std::condition_variable flushed;
+		std::thread preprocess_thread;
+		std::thread forward_thread;
+		std::thread postprocess_thread;
+
+		Cunder_Pipeline(
+			Cunder_Module *cunder_module,
+			Cunder_PreprocessCallback preprocess,
+			Cunder_PostprocessCallback postprocess,
+			void *user_data,
+			size_t queue_capacity)
+			: cunder_module(cunder_module),
+			  preprocess(preprocess),
+			  postprocess(postprocess),
+			  user_data(user_data),
+			  requests(queue_capacity),
+			  inputs(queue_capacity),
+			  outputs(queue_capacity)
+		{
+		}
+
+		// the submitted requests are processed before the stages exit
+		~Cunder_Pipeline()
+		{
+			requests.close();
+			if (preprocess_thread.joinable())
+				preprocess_thread.join();
+			if (forward_thread.joinable())
+				forward_thread.join();
+			if (postprocess_thread.joinable())
+				postprocess_thread.join();
+		}
+	};
+
+	// Requests are ordered by priority then deadline, a single dispatcher thread batches them into forwards.
+	struct Cunder_Scheduler
+	{
+		using clock = std::chrono::steady_clock;
+		static constexpr size_t latencies_capacity = 1024;
+
+		struct request
+		{
+			Cunder_Array inputs;
+			clock::time_point submitted_at;
+			clock::time_point deadline;
+			int priority;
+			std::shared_ptr<cunder::future_state> state;
+		};
+
+		// heap order, the top request is the most urgent
+		static bool
+		less_urgent(const request &a, const request &b)
+		{
+			if (a.priority != b.priority)
+				return a.priority < b.priority;
+			return a.deadline > b.deadline;
+		}
+
+		Cunder_Module *cunder_module;
+		Cunder_SchedulerConfig config;
+		std::mutex mutex;
+		std::condition_variable pending_changed;
+		std::vector<request> pending;
+		bool closed = false;
+		std::thread dispatcher;
+
+		// adaptive state and stats, guarded by the mutex
+		double window_ms;
+		double forward_ewma_ms = 0;   // per batch
+		double batch_size_ewma = 1;
+		std::vector<double> latencies_ms; // ring of the last latencies_capacity request latencies
+		size_t latencies_next = 0;
+		double p99_latency_ms = 0;
+		int64_t requests_count = 0;
+		int64_t batches_count = 0;
+		int64_t deadline_misses_count = 0;
+		int64_t dropped_count = 0;
+		int64_t rejected_count = 0;
+
+		Cunder_Scheduler(Cunder_Module *cunder_module, const Cunder_SchedulerConfig &config)
+			: cunder_module(cunder_module), config(config), window_ms(config.max_window_ms * 0.25)
+		{
+			latencies_ms.reserve(latencies_capacity);
+		}
+
+		// pending requests are dispatched before the dispatcher exits
+		~Cunder_Scheduler()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				closed = true;
+			}
+			pending_changed.notify_all();
+			if (dispatcher.joinable())
+				dispatcher.join();
+		}
+	};
+
+	struct Cunder_Allocator final : at::Allocator
+	{
+		std::function<void *(size_t, uint8_t)> aligned_allocator;
+		at::DeleterFnPtr deleter;
+		std::shared_ptr<cunder::caching_allocator> caching; // built-in backend, replaces the callbacks
+		at::Allocator *previous = nullptr;                  // restored by cunder_allocator_free
+		std::shared_ptr<cunder::allocation_stats> stats = std::make_shared<cunder::allocation_stats>();
+		mutable std::atomic<int64_t> references{1}; // cunder_allocator_free and every live allocation
+		std::atomic<Cunder_MemoryScope *> active_scope{nullptr}; // scope_peak_bytes belongs to this scope
+
+		// the callback backend keeps this header in front of the data to account the frees
+		struct allocation_header
+		{
+			const Cunder_Allocator *owner;
+			size_t nbytes;
+		};
+		static constexpr size_t header_bytes = c10::gAlignment;
+		static_assert(sizeof(allocation_header) <= header_bytes, "allocation header does not fit the alignment");
+
+		Cunder_Allocator() {}
+		~Cunder_Allocator() override {}
+
+		explicit Cunder_Allocator(const Cunder_CachingAllocatorConfig &config) : deleter(nullptr)
+		{
+			caching = std::make_shared<cunder::caching_allocator>(config, stats, &Cunder_Allocator::unref, this);
+		}
+
+		Cunder_Allocator(void *(*allocate)(size_t, uint8_t), void (*deallocate)(void *))
+		{
+			aligned_allocator = allocate;
+			deleter = deallocate;
+		}
+
+		at::DataPtr
+		allocate(size_t nbytes) const override
+		{
+			if (nbytes <= 0)
+				return {nullptr, nullptr, deleter, at::Device(at::DeviceType::CPU)};
+			if (caching != nullptr)
+			{
+				cunder::caching_allocator::block_header *header = caching->allocate(nbytes);
+				TORCH_CHECK(header != nullptr, "Cunder caching allocator: failed to allocate ", nbytes, " bytes");
+				references.fetch_add(1, std::memory_order_relaxed);
+				return {cunder::caching_allocator::data(header), header, &cunder::caching_allocator::release, at::Device(at::DeviceType::CPU)};
+			}
+			void *base = aligned_allocator(nbytes + header_bytes, c10::gAlignment);
+			TORCH_CHECK(base != nullptr, "Cunder allocator: failed to allocate ", nbytes, " bytes");
+			::new (base) allocation_header{this, nbytes};
+			stats->on_allocate(nbytes);
+			references.fetch_add(1, std::memory_order_relaxed);
+			return {(char *)base + header_bytes, base, &Cunder_Allocator::release, at::Device(at::DeviceType::CPU)};
+		}
+
+		// the data pointer is not the allocation context, raw allocations are not supported (see the README release notes)
+		at::DeleterFnPtr
+		raw_deleter() const override
+		{
+			return nullptr;
+		}
+
+		static void
+		release(void *context)
+		{
+			allocation_header *header = (allocation_header *)context;
+			const Cunder_Allocator *owner = header->owner;
+			owner->stats->on_free(header->nbytes);
+			owner->deleter(context);
+			unref(owner);
+		}
+
+		// the allocator is deleted by the last of cunder_allocator_free and the releases of its allocations
+		static void
+		unref(const void *allocator)
+		{
+			const Cunder_Allocator *owner = (const Cunder_Allocator *)allocator;
+			if (owner->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete owner;
+		}
+	};
+
+	// Handles and handle arrays are slab allocated, created and released only through these helpers.
+	inline static Cunder_Tensor *
+	_cunder_tensor_new(torch::Tensor tensor)
+	{
+		void *block = cunder::handle_slabs::allocate(1);
+		return ::new (block) Cunder_Tensor{std::move(tensor)};
+	}
+
+	inline static void
+	_cunder_tensor_delete(Cunder_Tensor *tensor)
+	{
+		tensor->~Cunder_Tensor();
+		cunder::handle_slabs::deallocate(tensor, 1);
+	}
+
+	inline static cunder::allocator_chain &
+	_cunder_installed_allocators()
+	{
+		static cunder::allocator_chain chain;
+		return chain;
+	}
+
+	inline static Cunder_Allocator *
+	_cunder_install_cpu_allocator(Cunder_Allocator *allocator)
+	{
+		cunder::allocator_chain &chain = _cunder_installed_allocators();
+		std::lock_guard<std::mutex> lock(chain.mutex);
+		allocator->previous = c10::GetAllocator(c10::DeviceType::CPU);
+		torch::SetAllocator(c10::DeviceType::CPU, allocator);
+		chain.allocators.push_back(allocator);
+		return allocator;
+	}
+
+	Cunder_Allocator *
+	cunder_set_cpu_allocator(void *(*allocate)(size_t, uint8_t), void (*deallocate)(void *))
+	{
+		return _cunder_install_cpu_allocator(
+			new Cunder_Allocator(std::forward<void *(*)(size_t, uint8_t)>(allocate), std::forward<c10::DeleterFnPtr>(deallocate)));
+	}
+
+	Cunder_CachingAllocatorConfig
+	cunder_caching_allocator_default_config()
+	{
+		Cunder_CachingAllocatorConfig config;
+		config.max_cached_bytes = (size_t)256 * 1024 * 1024;
+		config.per_thread_cache = true;
+		config.thread_cache_bytes = (size_t)1024 * 1024;
+		config.use_hugepages = false;
+		return config;
+	}
+
+	Cunder_Allocator *
+	cunder_set_caching_cpu_allocator(const Cunder_CachingAllocatorConfig *config)
+	{
+		Cunder_CachingAllocatorConfig allocator_config = config != nullptr ? *config : cunder_caching_allocator_default_config();
+		return _cunder_install_cpu_allocator(new Cunder_Allocator(allocator_config));
+	}
+
+	void
+	cunder_allocator_empty_cache(Cunder_Allocator *allocator)
+	{
+		if (allocator == nullptr || allocator->caching == nullptr)
+			return;
+		allocator->caching->flush_thread_cache();
+		allocator->caching->empty_cache();
+	}
+
+	int
+	cunder_allocator_stats(const Cunder_Allocator *allocator, Cunder_AllocatorStats *out_stats)
+	{
+		if (allocator == nullptr || out_stats == nullptr)
+			return -1;
+
+		const cunder::allocation_stats &stats = *allocator->stats;
+		out_stats->current_bytes = stats.current_bytes.load();
+		out_stats->peak_bytes = stats.peak_bytes.load();
+		out_stats->allocations_count = stats.allocations_count.load();
+		out_stats->deallocations_count = stats.deallocations_count.load();
+		out_stats->cached_bytes = allocator->caching != nullptr ? (int64_t)allocator->caching->idle_bytes() : 0;
+		for (int bin = 0; bin < CUNDER_ALLOCATOR_HISTOGRAM_BINS; ++bin)
+			out_stats->histogram[bin] = stats.histogram[bin].load();
+		return 0; // success
+	}
+
+	void
+	cunder_allocator_reset_peak(Cunder_Allocator *allocator)
+	{
+		if (allocator == nullptr)
+			return;
+		allocator->stats->peak_bytes.store(allocator->stats->current_bytes.load());
+	}
+
+	int
+	cunder_allocator_scope_begin(Cunder_Allocator *allocator, Cunder_MemoryScope *scope)
+	{
+		if (allocator == nullptr || scope == nullptr)
+			return -1;
+
+		// the peak is one counter per allocator, nested or concurrent scopes would reset each other
+		Cunder_MemoryScope *expected = nullptr;
+		if (allocator->active_scope.compare_exchange_strong(expected, scope) == false)
+			return -1;
+
+		scope->start_bytes = allocator->stats->current_bytes.load();
+		scope->start_allocations_count = allocator->stats->allocations_count.load();
+		scope->peak_bytes = 0;
+		scope->end_bytes = scope->start_bytes;
+		scope->allocations_count = 0;
+		allocator->stats->scope_peak_bytes.store(scope->start_bytes);
+		return 0; // success
+	}
+
+	int
+	cunder_allocator_scope_end(Cunder_Allocator *allocator, Cunder_MemoryScope *scope)
+	{
+		if (allocator == nullptr || scope == nullptr || allocator->active_scope.load() != scope)
+			return -1;
+
+		scope->end_bytes = allocator->stats->current_bytes.load();
+		scope->peak_bytes = allocator->stats->scope_peak_bytes.load() - scope->start_bytes;
+		scope->allocations_count = allocator->stats->allocations_count.load() - scope->start_allocations_count;
+		allocator->active_scope.store(nullptr);
+		return 0; // success
+	}
+
+	void
+	cunder_allocator_free(Cunder_Allocator *allocator)
+	{
+		if (allocator == nullptr)
+			return;
+
+		{
+			// unlink it from the chain: later allocations go back to the allocator it replaced, and an allocator
+			// installed on top of it now restores that one instead
+			cunder::allocator_chain &chain = _cunder_installed_allocators();
+			std::lock_guard<std::mutex> lock(chain.mutex);
+			at::Allocator *previous = allocator->previous != nullptr ? allocator->previous : c10::GetDefaultCPUAllocator();
+			if (c10::GetAllocator(c10::DeviceType::CPU) == allocator)
+				torch::SetAllocator(c10::DeviceType::CPU, previous);
+			for (Cunder_Allocator *installed : chain.allocators)
+				if (installed->previous == allocator)
+					installed->previous = previous;
+			chain.allocators.erase(std::remove(chain.allocators.begin(), chain.allocators.end(), allocator), chain.allocators.end());
+		}
+		if (allocator->caching != nullptr)
+			allocator->caching->flush_thread_cache(); // its reference would keep the caching allocator alive
+		Cunder_Allocator::unref(allocator); // deleted now, or by the release of its last live tensor
+
+	}
+
+	Torch_Version
+	cunder_torch_version()
+	{
+		return Torch_Version{TORCH_VERSION_MAJOR, TORCH_VERSION_MINOR, TORCH_VERSION_PATCH};
+	}
+
+	int
+	cunder_set_num_threads(int threads_count)
+	{
+		if (threads_count < 1)
+			return -1;
+
+		at::set_num_threads(threads_count);
+		return 0; // success
+	}
+
+	int
+	cunder_get_num_threads()
+	{
+		return at::get_num_threads();
+	}
+
+	int
+	cunder_set_num_interop_threads(int threads_count)
+	{
+		if (threads_count < 1)
+			return -1;
+
+		try
+		{
+			// only allowed once, before the inter-op pool starts
+			at::set_num_interop_threads(threads_count);
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			return -1;
+		}
+		return 0; // success
+	}
+
+	int
+	cunder_get_num_interop_threads()
+	{
+		return at::get_num_interop_threads();
+	}
+
+	int
+	cunder_set_jit_profiling_executor(bool enabled)
+	{
+		torch::jit::getProfilingMode() = enabled;
+		return 0; // success
+	}
+
+	bool
+	cunder_get_jit_profiling_executor()
+	{
+		return torch::jit::getProfilingMode();
+	}
+
+	int
+	cunder_set_thread_affinity(const int *cpus, size_t cpus_count)
+	{
+		return cunder::set_current_thread_affinity(cpus, cpus_count) ? 0 : -1;
+	}
+
+	int
+	cunder_get_thread_affinity(int *out_cpus, size_t capacity)
+	{
+		if (out_cpus == nullptr && capacity > 0)
+			return -1;
+		return cunder::get_current_thread_affinity(out_cpus, capacity);
+	}
+
+	int
+	cunder_set_intra_op_affinity(const int *cpus, size_t cpus_count)
+	{
+		if (cpus == nullptr || cpus_count == 0)
+			return -1;
+
+		// one chunk per intra-op thread, every thread joining the parallel region pins itself to the whole set,
+		// the calling thread included since it runs its share of the parallel regions
+		std::atomic<bool> pinned{true};
+		int threads_count = at::get_num_threads();
+		at::parallel_for(0, threads_count, 1, [&](int64_t, int64_t) {
+			if (cunder::set_current_thread_affinity(cpus, cpus_count) == false)
+				pinned.store(false);
+		});
+		if (cunder::set_current_thread_affinity(cpus, cpus_count) == false)
+			pinned.store(false);
+		return pinned.load() ? 0 : -1;
+	}
+
+	int
+	cunder_numa_node_cpus(int node, int *out_cpus, size_t capacity)
+	{
+		if (node < 0 || (out_cpus == nullptr && capacity > 0))
+			return -1;
+#ifdef __linux__
+		std::ifstream cpu_list_file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		std::string cpu_list;
+		if (cpu_list_file.is_open() == false || std::getline(cpu_list_file, cpu_list).fail())
+			return -1;
+		return cunder::parse_cpu_list(cpu_list, out_cpus, capacity);
+#elif defined(_WIN32)
+		ULONGLONG mask = 0;
+		if (node > 255 || GetNumaNodeProcessorMask((UCHAR)node, &mask) == FALSE)
+			return -1;
+		int count = 0;
+		for (int cpu = 0; cpu < 64; ++cpu, mask >>= 1)
+		{
+			if ((mask & 1) == 0)
+				continue;
+			if ((size_t)count < capacity)
+				out_cpus[count] = cpu;
+			++count;
+		}
+		return count;
+#else
+		return -1;
+#endif
+	}
+
+	Cunder_Array
+	cunder_tensor_allocate(size_t tensors_count)
+	{
+		Cunder_Tensor *tensors = (Cunder_Tensor *)cunder::handle_slabs::allocate(tensors_count);
+		for (size_t i = 0; i < tensors_count; ++i)
+			::new (&tensors[i]) Cunder_Tensor{torch::Tensor()};
+		return Cunder_Array{tensors, tensors_count};
+	}
+
+	void
+	cunder_tensor_array_set(Cunder_Array tensors_array, size_t i, Cunder_Tensor *tensor)
+	{
+		tensors_array.data[i].tensor = std::move(tensor->tensor);
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_array_get(Cunder_Array tensors_array, size_t i)
+	{
+		if (i > tensors_array.length)
+			return nullptr;
+		return &tensors_array.data[i];
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_clone(Cunder_Tensor *src)
+	{
+		if (src == nullptr)
+			return nullptr;
+
+		auto out = _cunder_tensor_new(src->tensor.clone());
+		return out;
+	}
+
+	void
+	cunder_tensor_clone_allocated(void *out_void, void *src_void)
+	{
+		Cunder_Tensor *src = (Cunder_Tensor *)src_void;
+		Cunder_Tensor *out = (Cunder_Tensor *)out_void;
+		if (src == nullptr)
+			return;
+
+		if (out->tensor.getIntrusivePtr() == nullptr)
+			out->tensor.unsafeReleaseTensorImpl();
+		out->tensor = src->tensor.clone();
+	}
+
+	int
+	cunder_tensor_free(Cunder_Tensor *self)
+	{
+		if (self == nullptr)
+			return -1;
+
+		_cunder_tensor_delete(self);
+
+		return 0; // success
+	}
+
+	int
+	cunder_module_free(Cunder_Module *self)
+	{
+		if (self == nullptr)
+			return -1;
+
+		delete self;
+
+		return 0; // success
+	}
+
+	int
+	cunder_array_free(Cunder_Array self)
+	{
+		if (self.data == nullptr)
+			return -1;
+
+		for (size_t i = 0; i < self.length; ++i)
+			self.data[i].~Cunder_Tensor();
+		cunder::handle_slabs::deallocate(self.data, self.length);
+		return 0; // success
+	}
+
+	template <typename Dim>
+	inline static bool
+	_cunder_check_initialization_param(int ndim, const Dim *shape, Cunder_DType dtype)
+	{
+		if (ndim < 1 || shape == nullptr || cunder::is_valid_dtype(dtype) == false)
+			return false;
+		for (int d = 0; d < ndim; ++d)
+			if (shape[d] < 0)
+				return false;
+		return true;
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_ones(int ndim, const int *shape, Cunder_DType dtype)
+	{
+		if (_cunder_check_initialization_param(ndim, shape, dtype) == false)
+			return nullptr;
+
+		std::vector<int64_t> vshape(shape, shape + ndim);
+		Cunder_Tensor *tensor = _cunder_tensor_new(torch::ones(vshape, cunder::get_libtorch_dtype(dtype)));
+		return tensor;
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_zeros(int ndim, const int *shape, Cunder_DType dtype)
+	{
+		if (_cunder_check_initialization_param(ndim, shape, dtype) == false)
+			return nullptr;
+
+		std::vector<int64_t> vshape(shape, shape + ndim);
+		Cunder_Tensor *tensor = _cunder_tensor_new(torch::zeros(vshape, cunder::get_libtorch_dtype(dtype)));
+		return tensor;
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_eye(int n, Cunder_DType dtype)
+	{
+		if (cunder::is_valid_dtype(dtype) == false)
+			return nullptr;
+
+		auto *tensor = _cunder_tensor_new(torch::eye(n, cunder::get_libtorch_dtype(dtype)));
+		return tensor;
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_range(int start, int end, int step, Cunder_DType dtype)
+	{
+		if (cunder::is_valid_dtype(dtype) == false)
+			return nullptr;
+
+		auto *tensor = _cunder_tensor_new(torch::range(start, end, step, cunder::get_libtorch_dtype(dtype)));
+		return tensor;
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_from_data(int ndim, const int *shape, void *data, Cunder_DType dtype)
+	{
+		if (_cunder_check_initialization_param(ndim, shape, dtype) == false)
+			return nullptr;
+
+		std::vector<int64_t> vshape(shape, shape + ndim);
+		Cunder_Tensor *tensor = _cunder_tensor_new(torch::from_blob(data, vshape, torch::TensorOptions(cunder::get_libtorch_dtype(dtype))));
+		return tensor;
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_from_data_strided(
+		int ndim, const int64_t *shape, const int64_t *strides, void *data, Cunder_DType dtype, Cunder_DataDeleter deleter, void *context)
+	{
+		if (_cunder_check_initialization_param(ndim, shape, dtype) == false)
+			return nullptr;
+		if (strides != nullptr)
+			for (int d = 0; d < ndim; ++d)
+				if (strides[d] < 0)
+					return nullptr;
+
+		c10::IntArrayRef vshape(shape, ndim);
+		torch::TensorOptions options(cunder::get_libtorch_dtype(dtype));
+		torch::Tensor tensor;
+		try
+		{
+			if (deleter == nullptr)
+				tensor = strides != nullptr ? torch::from_blob(data, vshape, c10::IntArrayRef(strides, ndim), options)
+											: torch::from_blob(data, vshape, options);
+			else
+			{
+				// the storage owns the deleter, it runs when the last tensor or view sharing it dies. It is armed
+				// once the tensor exists: if from_blob throws after wrapping the data, the caller keeps the ownership
+				std::shared_ptr<bool> armed = std::make_shared<bool>(false);
+				auto release = [deleter, context, armed](void *released) {
+					if (*armed)
+						deleter(released, context);
+				};
+				tensor = strides != nullptr ? torch::from_blob(data, vshape, c10::IntArrayRef(strides, ndim), release, options)
+											: torch::from_blob(data, vshape, release, options);
+				*armed = true;
+			}
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			return nullptr;
+		} catch (const std::exception &e)
+		{
+			printf("%s\n", e.what());
+			return nullptr;
+		}
+		return _cunder_tensor_new(std::move(tensor));
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_empty(int ndim, const int *shape, Cunder_DType dtype)
+	{
+		if (_cunder_check_initialization_param(ndim, shape, dtype) == false)
+			return nullptr;
+
+		std::vector<int64_t> vshape(shape, shape + ndim);
+		Cunder_Tensor *tensor = _cunder_tensor_new(torch::empty(vshape, cunder::get_libtorch_dtype(dtype)));
+		return tensor;
+	}
+
+	int
+	cunder_tensor_convert_from(Cunder_Tensor *destination, const void *data, Cunder_DType dtype)
+	{
+		if (destination == nullptr || data == nullptr || cunder::is_valid_dtype(dtype) == false || destination->tensor.defined() == false)
+			return -1;
+
+		try
+		{
+			// copy_ runs ATen's cast kernels, built per cpu capability (AVX2, AVX-512) and parallel over large tensors
+			torch::Tensor source = torch::from_blob(const_cast<void *>(data), destination->tensor.sizes(), torch::TensorOptions(cunder::get_libtorch_dtype(dtype)));
+			destination->tensor.copy_(source);
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			return -1;
+		}
+		return 0; // success
+	}
+
+	int
+	cunder_tensor_image_u8_into(
+		Cunder_Tensor *destination,
+		int64_t batch_index,
+		const uint8_t *data,
+		int height,
+		int width,
+		int channels,
+		size_t row_stride,
+		const float *mean,
+		const float *stddev,
+		Cunder_ImageLayout layout)
+	{
+		if (destination == nullptr || data == nullptr || height < 1 || width < 1 || channels < 1)
+			return -1;
+		if (row_stride == 0)
+			row_stride = (size_t)width * channels;
+		if (row_stride < (size_t)width * channels)
+			return -1;
+
+		const torch::Tensor &tensor = destination->tensor;
+		bool channels_last = layout == Cunder_ChannelsLast;
+		std::vector<int64_t> image_shape = channels_last ? std::vector<int64_t>{height, width, channels} : std::vector<int64_t>{channels, height, width};
+		if (tensor.defined() == false || tensor.scalar_type() != torch::kFloat32 || tensor.is_contiguous() == false || tensor.dim() != 4 ||
+			tensor.sizes().slice(1) != c10::IntArrayRef(image_shape) || batch_index < 0 || batch_index >= tensor.size(0))
+			return -1;
+
+		std::vector<float> alpha(channels);
+		std::vector<float> beta(channels);
+		for (int c = 0; c < channels; ++c)
+		{
+			float channel_std = stddev != nullptr ? stddev[c] : 1.0f;
+			if (channel_std == 0.0f)
+				return -1;
+			alpha[c] = 1.0f / channel_std;
+			beta[c] = -(mean != nullptr ? mean[c] : 0.0f) / channel_std;
+		}
+
+		float *out = tensor.data_ptr<float>() + batch_index * tensor.stride(0);
+		cunder::normalize_u8_image(data, height, width, channels, (int64_t)row_stride, alpha.data(), beta.data(), channels_last, out);
+		return 0; // success
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_from_image_u8(
+		const uint8_t *data,
+		int height,
+		int width,
+		int channels,
+		size_t row_stride,
+		const float *mean,
+		const float *stddev,
+		Cunder_ImageLayout layout)
+	{
+		if (data == nullptr || height < 1 || width < 1 || channels < 1)
+			return nullptr;
+
+		std::vector<int64_t> shape =
+			layout == Cunder_ChannelsLast ? std::vector<int64_t>{1, height, width, channels} : std::vector<int64_t>{1, channels, height, width};
+		Cunder_Tensor *tensor = _cunder_tensor_new(torch::empty(shape, torch::kFloat32));
+		if (cunder_tensor_image_u8_into(tensor, 0, data, height, width, channels, row_stride, mean, stddev, layout) != 0)
+		{
+			_cunder_tensor_delete(tensor);
+			return nullptr;
+		}
+		return tensor;
+	}
+
+	void
+	cunder_tensor_to(Cunder_Tensor *tensor, Cunder_DType dtype)
+	{
+		if (tensor == nullptr)
+			return;
+		tensor->tensor = tensor->tensor.toType(cunder::get_libtorch_dtype(dtype));
+	}
+
+	void
+	cunder_tensor_print(const Cunder_Tensor *tensor)
+	{
+		if (tensor == nullptr)
+			return;
+		print(tensor->tensor);
+		printf("\n");
+	}
+
+	Cunder_DType
+	cunder_tensor_type(const Cunder_Tensor *tensor)
+	{
+		return cunder::get_cunder_dtype(tensor->tensor.scalar_type());
+	}
+
+	int64_t
+	cunder_tensor_ndim(const Cunder_Tensor *tensor)
+	{
+		return tensor->tensor.dim();
+	}
+
+	void
+	cunder_tensor_shape(const Cunder_Tensor *tensor, int64_t *out_shape)
+	{
+		int d = 0;
+		for (int64_t size : tensor->tensor.sizes())
+			out_shape[d++] = size;
+	}
+
+	int64_t
+	cunder_tensor_numel(const Cunder_Tensor *tensor)
+	{
+		return tensor->tensor.numel();
+	}
+
+	void
+	cunder_tensor_strides(const Cunder_Tensor *tensor, int64_t *out_strides)
+	{
+		int d = 0;
+		for (int64_t stride : tensor->tensor.strides())
+			out_strides[d++] = stride;
+	}
+
+	bool
+	cunder_tensor_is_contiguous(const Cunder_Tensor *tensor)
+	{
+		return tensor->tensor.is_contiguous();
+	}
+
+	int64_t
+	cunder_tensor_dim_size(const Cunder_Tensor *tensor, int64_t dim)
+	{
+		return tensor->tensor.size(dim);
+	}
+
+	const bool *
+	cunder_tensor_accessor_b(const Cunder_Tensor *tensor)
+	{
+		return tensor->tensor.data_ptr<bool>();
+	}
+
+	const uint8_t *
+	cunder_tensor_accessor_u8(const Cunder_Tensor *tensor)
+	{
+		return tensor->tensor.data_ptr<uint8_t>();
+	}
+
+	const int8_t *
+	cunder_tensor_accessor_i8(const Cunder_Tensor *tensor)
+	{
+		return tensor->tensor.data_ptr<int8_t>();
+	}
+
+	const int16_t *
+	cunder_tensor_accessor_i16(const Cunder_Tensor *tensor)
+	{
+		return tensor->tensor.data_ptr<int16_t>();
+	}
+
+	const int32_t *
+	cunder_tensor_accessor_i32(const Cunder_Tensor *tensor)
+	{
+		return tensor->tensor.data_ptr<int32_t>();
+	}
+
+	const int64_t *
+	cunder_tensor_accessor_i64(const Cunder_Tensor *tensor)
+	{
+		return tensor->tensor.data_ptr<int64_t>();
+	}
+
+	const float *
+	cunder_tensor_accessor_f32(const Cunder_Tensor *tensor)
+	{
+		return tensor->tensor.data_ptr<float>();
+	}
+
+	const double *
+	cunder_tensor_accessor_f64(const Cunder_Tensor *tensor)
+	{
+		return tensor->tensor.data_ptr<double>();
+	}
+
+	const uint16_t *
+	cunder_tensor_accessor_f16(const Cunder_Tensor *tensor)
+	{
+		return (const uint16_t *)tensor->tensor.data_ptr<at::Half>();
+	}
+
+	const uint16_t *
+	cunder_tensor_accessor_bf16(const Cunder_Tensor *tensor)
+	{
+		return (const uint16_t *)tensor->tensor.data_ptr<at::BFloat16>();
+	}
+
+	// Run a post-processing operator, its result becomes a new handle, NULL on failure.
+	template <typename Op>
+	inline static Cunder_Tensor *
+	_cunder_tensor_op(Op op)
+	{
+		try
+		{
+			torch::Tensor result = op();
+			if (result.defined() == false)
+				return nullptr;
+			return _cunder_tensor_new(std::move(result));
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			return nullptr;
+		}
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_unary(const Cunder_Tensor *tensor, Cunder_UnaryOp op)
+	{
+		if (tensor == nullptr)
+			return nullptr;
+
+		const torch::Tensor &input = tensor->tensor;
+		return _cunder_tensor_op([&]() -> torch::Tensor {
+			switch (op)
+			{
+			case Cunder_Abs:
+				return input.abs();
+			case Cunder_Neg:
+				return input.neg();
+			case Cunder_Exp:
+				return input.exp();
+			case Cunder_Log:
+				return input.log();
+			case Cunder_Sqrt:
+				return input.sqrt();
+			case Cunder_Sigmoid:
+				return input.sigmoid();
+			case Cunder_Tanh:
+				return input.tanh();
+			case Cunder_Relu:
+				return input.relu();
+			default:
+				return torch::Tensor();
+			}
+		});
+	}
+
+	inline static torch::Tensor
+	_cunder_binary(const torch::Tensor &a, const torch::Tensor &b, Cunder_BinaryOp op)
+	{
+		switch (op)
+		{
+		case Cunder_Add:
+			return a + b;
+		case Cunder_Sub:
+			return a - b;
+		case Cunder_Mul:
+			return a * b;
+		case Cunder_Div:
+			return a / b;
+		case Cunder_Maximum:
+			return torch::maximum(a, b);
+		case Cunder_Minimum:
+			return torch::minimum(a, b);
+		default:
+			return torch::Tensor();
+		}
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_binary(const Cunder_Tensor *a, const Cunder_Tensor *b, Cunder_BinaryOp op)
+	{
+		if (a == nullptr || b == nullptr)
+			return nullptr;
+		return _cunder_tensor_op([&] { return _cunder_binary(a->tensor, b->tensor, op); });
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_binary_scalar(const Cunder_Tensor *a, double b, Cunder_BinaryOp op)
+	{
+		if (a == nullptr)
+			return nullptr;
+		// a wrapped number keeps the tensor dtype, as a python scalar would
+		return _cunder_tensor_op([&] { return _cunder_binary(a->tensor, at::wrapped_scalar_tensor(b), op); });
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_reduce(const Cunder_Tensor *tensor, Cunder_ReduceOp op, const int64_t *dims, size_t dims_count, bool keepdim)
+	{
+		if (tensor == nullptr || (dims == nullptr && dims_count > 0))
+			return nullptr;
+
+		const torch::Tensor &input = tensor->tensor;
+		std::vector<int64_t> reduced_dims;
+		if (dims_count > 0)
+			reduced_dims.assign(dims, dims + dims_count);
+		else
+			for (int64_t d = 0; d < input.dim(); ++d)
+				reduced_dims.push_back(d);
+
+		return _cunder_tensor_op([&]() -> torch::Tensor {
+			switch (op)
+			{
+			case Cunder_Sum:
+				return input.sum(reduced_dims, keepdim);
+			case Cunder_Mean:
+				return input.mean(reduced_dims, keepdim);
+			case Cunder_Max:
+				return input.amax(reduced_dims, keepdim);
+			case Cunder_Min:
+				return input.amin(reduced_dims, keepdim);
+			default:
+				return torch::Tensor();
+			}
+		});
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_softmax(const Cunder_Tensor *tensor, int64_t dim)
+	{
+		if (tensor == nullptr)
+			return nullptr;
+		return _cunder_tensor_op([&] { return tensor->tensor.softmax(dim); });
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_log_softmax(const Cunder_Tensor *tensor, int64_t dim)
+	{
+		if (tensor == nullptr)
+			return nullptr;
+		return _cunder_tensor_op([&] { return tensor->tensor.log_softmax(dim); });
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_argmax(const Cunder_Tensor *tensor, int64_t dim, bool keepdim)
+	{
+		if (tensor == nullptr)
+			return nullptr;
+		return _cunder_tensor_op([&] { return tensor->tensor.argmax(dim, keepdim); });
+	}
+
+	int
+	cunder_tensor_topk(
+		const Cunder_Tensor *tensor, int64_t k, int64_t dim, bool largest, Cunder_Tensor **out_values, Cunder_Tensor **out_indices)
+	{
+		if (tensor == nullptr || out_values == nullptr || out_indices == nullptr)
+			return -1;
+
+		torch::Tensor values;
+		torch::Tensor indices;
+		try
+		{
+			std::tie(values, indices) = tensor->tensor.topk(k, dim, largest, /* sorted */ true);
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			return -1;
+		}
+		*out_values = _cunder_tensor_new(std::move(values));
+		*out_indices = _cunder_tensor_new(std::move(indices));
+		return 0; // success
+	}
+
+	inline static torch::Tensor
+	_cunder_compare(const torch::Tensor &a, const torch::Tensor &b, Cunder_CompareOp op)
+	{
+		switch (op)
+		{
+		case Cunder_Equal:
+			return a.eq(b);
+		case Cunder_NotEqual:
+			return a.ne(b);
+		case Cunder_Greater:
+			return a.gt(b);
+		case Cunder_GreaterEqual:
+			return a.ge(b);
+		case Cunder_Less:
+			return a.lt(b);
+		case Cunder_LessEqual:
+			return a.le(b);
+		default:
+			return torch::Tensor();
+		}
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_compare(const Cunder_Tensor *a, const Cunder_Tensor *b, Cunder_CompareOp op)
+	{
+		if (a == nullptr || b == nullptr)
+			return nullptr;
+		return _cunder_tensor_op([&] { return _cunder_compare(a->tensor, b->tensor, op); });
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_compare_scalar(const Cunder_Tensor *a, double b, Cunder_CompareOp op)
+	{
+		if (a == nullptr)
+			return nullptr;
+		return _cunder_tensor_op([&] { return _cunder_compare(a->tensor, at::wrapped_scalar_tensor(b), op); });
+	}
+
+	const void *
+	cunder_tensor_data_view(const Cunder_Tensor *tensor, Cunder_DType dtype)
+	{
+		if (tensor == nullptr || tensor->tensor.defined() == false || cunder::is_valid_dtype(dtype) == false)
+			return nullptr;
+		if (tensor->tensor.scalar_type() != cunder::get_libtorch_dtype(dtype) || tensor->tensor.is_contiguous() == false)
+			return nullptr;
+		return tensor->tensor.data_ptr();
+	}
+
+	int
+	cunder_tensor_export(const Cunder_Tensor *tensor, void *data, size_t nbytes, Cunder_DType dtype, const int64_t *strides)
+	{
+		if (tensor == nullptr || tensor->tensor.defined() == false || data == nullptr || cunder::is_valid_dtype(dtype) == false)
+			return -1;
+
+		const torch::Tensor &source = tensor->tensor;
+		c10::ScalarType scalar_type = cunder::get_libtorch_dtype(dtype);
+		int64_t ndim = source.dim();
+		std::vector<int64_t> destination_strides(ndim);
+		if (strides != nullptr)
+			destination_strides.assign(strides, strides + ndim);
+		else
+			for (int64_t d = ndim - 1, stride = 1; d >= 0; stride *= std::max<int64_t>(1, source.size(d)), --d)
+				destination_strides[d] = stride;
+
+		// bytes spanned by the destination layout
+		int64_t span = source.numel() > 0 ? 1 : 0;
+		for (int64_t d = 0; d < ndim && span > 0; ++d)
+		{
+			if (destination_strides[d] < 0)
+				return -1;
+			span += (source.size(d) - 1) * destination_strides[d];
+		}
+		if ((size_t)span * c10::elementSize(scalar_type) > nbytes)
+			return -1;
+		if (span == 0)
+			return 0;
+
+		try
+		{
+			torch::Tensor destination = torch::from_blob(data, source.sizes(), destination_strides, torch::TensorOptions(scalar_type));
+			if (destination.data_ptr() == source.data_ptr() && destination.scalar_type() == source.scalar_type() &&
+				destination.strides() == source.strides())
+				return 0; // already in place
+
+			// copy_ casts and gathers in one pass (memcpy for matching layouts), parallel over large tensors
+			destination.copy_(source);
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			return -1;
+		}
+		return 0; // success
+	}
+
+	int
+	cunder_tensor_file_save(const char *filename, const char *const *names, Cunder_Array tensors)
+	{
+		if (filename == nullptr || (tensors.length > 0 && (names == nullptr || tensors.data == nullptr)))
+			return -1;
+
+		FILE *out = fopen(filename, "wb");
+		if (out == nullptr)
+			return -1;
+
+		cunder::tensor_file_header header{};
+		memcpy(header.magic, cunder::tensor_file_magic, sizeof(header.magic));
+		header.version = cunder::tensor_file_version;
+		header.byte_order = cunder::tensor_file_byte_order;
+		header.tensors_count = tensors.length;
+
+		static const char padding[cunder::tensor_file_alignment] = {};
+		std::string index;
+		uint64_t offset = sizeof(header);
+		bool written = fwrite(&header, sizeof(header), 1, out) == 1;
+		for (size_t i = 0; i < tensors.length && written; ++i)
+		{
+			const torch::Tensor &source = tensors.data[i].tensor;
+			if (source.defined() == false || names[i] == nullptr || cunder::get_cunder_dtype(source.scalar_type()) == Cunder_Invalid)
+			{
+				written = false;
+				break;
+			}
+			torch::Tensor tensor = source.contiguous();
+
+			size_t padding_bytes = (cunder::tensor_file_alignment - offset % cunder::tensor_file_alignment) % cunder::tensor_file_alignment;
+			written = fwrite(padding, 1, padding_bytes, out) == padding_bytes;
+			offset += padding_bytes;
+			uint64_t nbytes = tensor.nbytes();
+			written = written && (nbytes == 0 || fwrite(tensor.data_ptr(), 1, nbytes, out) == nbytes);
+
+			uint32_t name_length = (uint32_t)strlen(names[i]);
+			cunder::append_pod(index, name_length);
+			index.append(names[i], name_length);
+			cunder::append_pod(index, (int32_t)cunder::get_cunder_dtype(tensor.scalar_type()));
+			cunder::append_pod(index, (int32_t)tensor.dim());
+			for (int64_t size : tensor.sizes())
+				cunder::append_pod(index, size);
+			cunder::append_pod(index, offset);
+			cunder::append_pod(index, nbytes);
+			offset += nbytes;
+		}
+
+		// the header is rewritten once the index position is known
+		header.index_offset = offset;
+		header.index_bytes = index.size();
+		written = written && fwrite(index.data(), 1, index.size(), out) == index.size();
+		written = written && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+		written = fclose(out) == 0 && written;
+		if (written == false)
+		{
+			remove(filename);
+			return -1;
+		}
+		return 0; // success
+	}
+
+	Cunder_TensorFile *
+	cunder_tensor_file_open(const char *filename)
+	{
+		if (filename == nullptr)
+			return nullptr;
+
+		// copy on write, the views are writable as LibTorch expects and the file is never modified
+		auto mapping = std::make_shared<cunder::mapped_file>();
+		if (mapping->open(filename, true) == false || mapping->size < sizeof(cunder::tensor_file_header))
+			return nullptr;
+
+		cunder::tensor_file_header header;
+		memcpy(&header, mapping->data, sizeof(header));
+		if (memcmp(header.magic, cunder::tensor_file_magic, sizeof(header.magic)) != 0 || header.version != cunder::tensor_file_version ||
+			header.byte_order != cunder::tensor_file_byte_order || header.index_offset > mapping->size ||
+			header.index_bytes > mapping->size - header.index_offset)
+			return nullptr;
+
+		const char *base = (const char *)mapping->data;
+		cunder::memory_reader reader{base + header.index_offset, base + header.index_offset + header.index_bytes};
+		std::vector<Cunder_TensorFile::item> items;
+		for (uint64_t i = 0; i < header.tensors_count; ++i)
+		{
+			Cunder_TensorFile::item item;
+			uint32_t name_length = 0;
+			int32_t dtype = 0;
+			int32_t ndim = 0;
+			uint64_t nbytes = 0;
+			if (reader.read(&name_length, sizeof(name_length)) == false || name_length > (size_t)(reader.end - reader.cursor))
+				return nullptr;
+			item.name.assign(reader.cursor, name_length);
+			reader.cursor += name_length;
+			if (reader.read(&dtype, sizeof(dtype)) == false || reader.read(&ndim, sizeof(ndim)) == false ||
+				cunder::is_valid_dtype((Cunder_DType)dtype) == false || ndim < 0 || ndim > 64)
+				return nullptr;
+			item.dtype = (Cunder_DType)dtype;
+			item.shape.resize(ndim);
+
+			uint64_t numel = 1;
+			for (int32_t d = 0; d < ndim; ++d)
+			{
+				if (reader.read(&item.shape[d], sizeof(int64_t)) == false || item.shape[d] < 0)
+					return nullptr;
+				if (item.shape[d] != 0 && numel > UINT64_MAX / (uint64_t)item.shape[d])
+					return nullptr;
+				numel *= (uint64_t)item.shape[d];
+			}
+			if (reader.read(&item.offset, sizeof(item.offset)) == false || reader.read(&nbytes, sizeof(nbytes)) == false)
+				return nullptr;
+
+			// the data must match the shape and lie before the index
+			uint64_t element_size = (uint64_t)cunder::get_dtype_size(item.dtype);
+			if (numel > nbytes / element_size || numel * element_size != nbytes || item.offset % cunder::tensor_file_alignment != 0 ||
+				item.offset > header.index_offset || nbytes > header.index_offset - item.offset)
+				return nullptr;
+			items.push_back(std::move(item));
+		}
+
+		return new Cunder_TensorFile{std::move(mapping), std::move(items)};
+	}
+
+	int
+	cunder_tensor_file_close(Cunder_TensorFile *file)
+	{
+		if (file == nullptr)
+			return -1;
+
+		delete file;
+		return 0; // success
+	}
+
+	size_t
+	cunder_tensor_file_count(const Cunder_TensorFile *file)
+	{
+		if (file == nullptr)
+			return 0;
+		return file->tensors.size();
+	}
+
+	const char *
+	cunder_tensor_file_name(const Cunder_TensorFile *file, size_t i)
+	{
+		if (file == nullptr || i >= file->tensors.size())
+			return nullptr;
+		return file->tensors[i].name.c_str();
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_file_get_at(const Cunder_TensorFile *file, size_t i)
+	{
+		if (file == nullptr || i >= file->tensors.size())
+			return nullptr;
+
+		// the view holds a reference on the mapping, it stays valid after the file is closed
+		const Cunder_TensorFile::item &item = file->tensors[i];
+		std::shared_ptr<cunder::mapped_file> mapping = file->mapping;
+		void *data = (char *)mapping->data + item.offset;
+		torch::Tensor tensor =
+			torch::from_blob(data, item.shape, [mapping](void *) {}, torch::TensorOptions(cunder::get_libtorch_dtype(item.dtype)));
+		return _cunder_tensor_new(std::move(tensor));
+	}
+
+	Cunder_Tensor *
+	cunder_tensor_file_get(const Cunder_TensorFile *file, const char *name)
+	{
+		if (file == nullptr || name == nullptr)
+			return nullptr;
+
+		for (size_t i = 0; i < file->tensors.size(); ++i)
+			if (file->tensors[i].name == name)
+				return cunder_tensor_file_get_at(file, i);
+		return nullptr;
+	}
+
+	Cunder_Module *
+	cunder_module_load(const char *filename)
+	{
+		torch::jit::Module module;
+		cunder::last_error().clear();
+
+		try
+		{
+			module = torch::jit::load(filename);
+		} catch (const c10::Error &e)
+		{
+			cunder::last_error() = e.what_without_backtrace();
+			return nullptr;
+		}
+
+		Cunder_Module *cunder_module = new Cunder_Module{module};
+		return cunder_module;
+	}
+
+	const char *
+	cunder_module_last_error()
+	{
+		return cunder::last_error().c_str();
+	}
+
+	inline static Cunder_Module *
+	_cunder_module_load_adapter(std::shared_ptr<caffe2::serialize::ReadAdapterInterface> adapter)
+	{
+		torch::jit::Module module;
+
+		try
+		{
+			module = torch::jit::load(std::move(adapter));
+		} catch (const c10::Error &e)
+		{
+			cunder::last_error() = e.what_without_backtrace();
+			return nullptr;
+		}
+
+		Cunder_Module *cunder_module = new Cunder_Module{module};
+		return cunder_module;
+	}
+
+	Cunder_Module *
+	cunder_module_load_buffer(const void *data, size_t size)
+	{
+		cunder::last_error().clear();
+		if (data == nullptr || size == 0)
+		{
+			cunder::last_error() = "empty buffer";
+			return nullptr;
+		}
+
+		return _cunder_module_load_adapter(std::make_shared<cunder::memory_read_adapter>(data, size));
+	}
+
+	Cunder_Module *
+	cunder_module_load_mmap(const char *filename)
+	{
+		cunder::last_error().clear();
+		if (filename == nullptr)
+		{
+			cunder::last_error() = "no filename";
+			return nullptr;
+		}
+
+		auto mapping = std::make_shared<cunder::mapped_file>();
+		if (mapping->open(filename, false) == false)
+		{
+			cunder::last_error() = std::string("failed to map ") + filename;
+			return nullptr;
+		}
+
+		// the mapping is released with the adapter once the module is loaded
+		return _cunder_module_load_adapter(std::make_shared<cunder::memory_read_adapter>(mapping->data, mapping->size, mapping));
+	}
+
+	Cunder_Module *
+	cunder_module_freeze(const Cunder_Module *cunder_module, bool optimize_for_inference)
+	{
+		if (cunder_module == nullptr)
+			return nullptr;
+
+		torch::jit::Module frozen;
+		try
+		{
+			// freezing needs eval mode, leave the source module untouched
+			torch::jit::Module module = cunder_module->module;
+			if (module.is_training())
+			{
+				module = module.clone();
+				module.eval();
+			}
+
+			// inlines the parameters and attributes as constants, folds conv-bn and removes dropout
+			frozen = torch::jit::freeze(module);
+			if (optimize_for_inference)
+				frozen = torch::jit::optimize_for_inference(frozen);
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			printf("%s\n", e.what());
+			return nullptr;
+		}
+
+		return new Cunder_Module{frozen};
+	}
+
+	void
+	cunder_module_dump(const Cunder_Module *module, bool print_method_bodies, bool print_attr_values, bool print_param_values)
+	{
+		if (module == nullptr)
+			return;
+
+		module->module.dump(print_method_bodies, print_attr_values, print_param_values);
+	}
+
+	void
+	cunder_module_eval(Cunder_Module *cunder_module)
+	{
+		cunder_module->module.eval();
+	}
+
+	size_t
+	cunder_module_input_num(Cunder_Module *cunder_module)
+	{
+		return cunder_module->module.get_method("forward").num_inputs() - 1; // remove self argument
+	}
+
+	Cunder_Array
+	cunder_module_forward(Cunder_Module *cunder_module, Cunder_Array tensors_array)
+	{
+		std::vector<torch::IValue> values;
+		values.resize(tensors_array.length);
+		for (size_t i = 0; i < tensors_array.length; ++i)
+			values[i] = tensors_array.data[i].tensor;
+		auto output = cunder_module->module.forward(values);
+		if (output.isTensor())
+		{
+			Cunder_Array output_tensors = cunder_tensor_allocate(1);
+			output_tensors.data[0].tensor = output.toTensor();
+			return output_tensors;
+		}
+		else if (output.isTensorList())
+		{
+			auto output_tensor_list = output.toTensorList();
+			size_t output_count = output_tensor_list.size();
+			Cunder_Array output_tensors = cunder_tensor_allocate(output_count);
+			for (size_t i = 0; i < output_count; ++i)
+				output_tensors.data[i].tensor = output_tensor_list[i];
+			return output_tensors;
+		}
+		else if (output.isTuple() && output.toTuple()->elements().empty() == false && output.toTuple()->elements()[0].isTensor())
+		{
+			auto output_tensor_list = output.toTuple()->elements();
+			size_t output_count = output_tensor_list.size();
+			Cunder_Array output_tensors = cunder_tensor_allocate(output_count);
+			for (size_t i = 0; i < output_count; ++i)
+				output_tensors.data[i].tensor = output_tensor_list[i].toTensor();
+			return output_tensors;
+		}
+		AT_ASSERT(false, "The module return type is not supported, got kind: ", output.tagKind());
+		return {nullptr, 0};
+	}
+
+	// Collect the module output tensors (tensor, tensor list or tuple of tensors).
+	inline static bool
+	_cunder_output_tensors(const torch::IValue &output, std::vector<torch::Tensor> &out_tensors)
+	{
+		if (output.isTensor())
+		{
+			out_tensors.push_back(output.toTensor());
+			return true;
+		}
+		else if (output.isTensorList())
+		{
+			out_tensors = output.toTensorVector();
+			return true;
+		}
+		else if (output.isTuple() && output.toTuple()->elements().empty() == false)
+		{
+			for (const torch::IValue &element : output.toTuple()->elements())
+			{
+				if (element.isTensor() == false)
+					return false;
+				out_tensors.push_back(element.toTensor());
+			}
+			return true;
+		}
+		return false;
+	}
+
+	Cunder_Module *
+	cunder_module_replicate(const Cunder_Module *cunder_module)
+	{
+		if (cunder_module == nullptr)
+			return nullptr;
+
+		torch::jit::Module replica;
+		try
+		{
+			// an inplace clone rebuilds the module objects, types and methods but keeps the attribute values,
+			// the parameters, buffers and constant tensors are the same storages
+			replica = cunder_module->module.clone(/* inplace */ true);
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			printf("%s\n", e.what());
+			return nullptr;
+		}
+		return new Cunder_Module{replica};
+	}
+
+	int
+	cunder_module_replicate_n(const Cunder_Module *cunder_module, size_t replicas_count, Cunder_Module **out_replicas)
+	{
+		if (cunder_module == nullptr || out_replicas == nullptr)
+			return -1;
+
+		for (size_t i = 0; i < replicas_count; ++i)
+		{
+			out_replicas[i] = cunder_module_replicate(cunder_module);
+			if (out_replicas[i] == nullptr)
+			{
+				for (size_t created = 0; created < i; ++created)
+					cunder_module_free(out_replicas[created]);
+				return -1;
+			}
+		}
+		return 0; // success
+	}
+
+	// Replace the aten::linear nodes having constant float weights by quantized::linear_dynamic ones, the weights
+	// are quantized per output channel (symmetric qint8) and prepacked ahead of time. Returns the replaced count.
+	inline static int64_t
+	_cunder_quantize_dynamic_linear(const std::shared_ptr<torch::jit::Graph> &graph)
+	{
+		std::vector<torch::jit::Node *> linears;
+		std::function<void(torch::jit::Block *)> collect = [&](torch::jit::Block *block) {
+			for (torch::jit::Node *node : block->nodes())
+			{
+				if (node->kind() == c10::Symbol::fromQualString("aten::linear"))
+					linears.push_back(node);
+				for (torch::jit::Block *sub_block : node->blocks())
+					collect(sub_block);
+			}
+		};
+		collect(graph->block());
+
+		const c10::OperatorHandle &prepack = c10::Dispatcher::singleton().findSchemaOrThrow("quantized::linear_prepack", "");
+		// fbgemm needs the activations range reduced to 7 bits to avoid overflows in its int16 accumulation
+		bool reduce_range = at::globalContext().qEngine() == at::QEngine::FBGEMM;
+
+		int64_t quantized_count = 0;
+		for (torch::jit::Node *linear : linears)
+		{
+			c10::optional<torch::IValue> weight_value = torch::jit::toIValue(linear->input(1));
+			c10::optional<torch::IValue> bias_value = torch::jit::toIValue(linear->input(2));
+			if (weight_value.has_value() == false || bias_value.has_value() == false || weight_value->isTensor() == false)
+				continue;
+			torch::Tensor weight = weight_value->toTensor();
+			if (weight.dim() != 2 || weight.scalar_type() != torch::kFloat32)
+				continue;
+
+			torch::Tensor scales = (weight.abs().amax({1}) / 127.0).clamp_min(1e-8).to(torch::kDouble);
+			torch::Tensor zero_points = torch::zeros({weight.size(0)}, torch::kLong);
+			torch::Tensor quantized_weight = torch::quantize_per_channel(weight.contiguous(), scales, zero_points, 0, torch::kQInt8);
+
+			torch::jit::Stack stack{quantized_weight, *bias_value};
+			prepack.callBoxed(&stack);
+
+			torch::jit::WithInsertPoint insert_point(linear);
+			torch::jit::Value *packed_params = graph->insertConstant(stack[0]);
+			torch::jit::Node *linear_dynamic = graph->create(
+				c10::Symbol::fromQualString("quantized::linear_dynamic"), {linear->input(0), packed_params, graph->insertConstant(reduce_range)});
+			linear_dynamic->insertBefore(linear);
+			linear_dynamic->output()->setType(linear->output()->type());
+			linear->output()->replaceAllUsesWith(linear_dynamic->output());
+			linear->destroy();
+			++quantized_count;
+		}
+
+		torch::jit::EliminateDeadCode(graph);
+		torch::jit::ConstantPooling(graph);
+		return quantized_count;
+	}
+
+	// Compare the quantized outputs to the reference ones over the calibration batch.
+	inline static void
+	_cunder_quantization_errors(
+		torch::jit::Module &reference, torch::jit::Module &quantized, const Cunder_Array &calibration_inputs, Cunder_QuantizationReport *report)
+	{
+		std::vector<torch::IValue> values;
+		for (size_t i = 0; i < calibration_inputs.length; ++i)
+			values.push_back(calibration_inputs.data[i].tensor);
+
+		std::vector<torch::Tensor> reference_outputs;
+		std::vector<torch::Tensor> quantized_outputs;
+		{
+			c10::InferenceMode inference;
+			if (_cunder_output_tensors(reference.forward(values), reference_outputs) == false ||
+				_cunder_output_tensors(quantized.forward(values), quantized_outputs) == false)
+				return;
+		}
+
+		double error_sum = 0;
+		double error_squares = 0;
+		double reference_squares = 0;
+		int64_t compared_count = 0;
+		for (size_t o = 0; o < std::min(reference_outputs.size(), quantized_outputs.size()); ++o)
+		{
+			if (reference_outputs[o].is_floating_point() == false || reference_outputs[o].sizes() != quantized_outputs[o].sizes())
+				continue;
+			torch::Tensor expected = reference_outputs[o].to(torch::kDouble);
+			torch::Tensor error = (quantized_outputs[o].to(torch::kDouble) - expected).abs();
+			if (error.numel() == 0)
+				continue;
+			report->max_abs_error = std::max(report->max_abs_error, error.max().item<double>());
+			error_sum += error.sum().item<double>();
+			error_squares += error.pow(2).sum().item<double>();
+			reference_squares += expected.pow(2).sum().item<double>();
+			compared_count += error.numel();
+		}
+		if (compared_count > 0)
+		{
+			report->mean_abs_error = error_sum / (double)compared_count;
+			report->relative_error = reference_squares > 0 ? std::sqrt(error_squares / reference_squares) : 0;
+		}
+		report->compared_elements_count = compared_count;
+	}
+
+	Cunder_Module *
+	cunder_module_quantize_dynamic(const Cunder_Module *cunder_module, const Cunder_Array *calibration_inputs, Cunder_QuantizationReport *out_report)
+	{
+		if (cunder_module == nullptr)
+			return nullptr;
+
+		Cunder_QuantizationReport report{};
+		torch::jit::Module quantized;
+		try
+		{
+			torch::jit::Module module = cunder_module->module;
+			if (module.is_training())
+			{
+				module = module.clone();
+				module.eval();
+			}
+
+			// freezing turns the weights into constants the graph pass can quantize
+			quantized = torch::jit::freeze(module);
+			report.quantized_layers_count = _cunder_quantize_dynamic_linear(quantized.get_method("forward").graph());
+
+			if (calibration_inputs != nullptr && calibration_inputs->data != nullptr)
+				_cunder_quantization_errors(module, quantized, *calibration_inputs, &report);
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			printf("%s\n", e.what());
+			return nullptr;
+		} catch (const std::exception &e)
+		{
+			printf("%s\n", e.what());
+			return nullptr;
+		}
+
+		if (out_report != nullptr)
+			*out_report = report;
+		return new Cunder_Module{quantized};
+	}
+
+	int
+	cunder_module_forward_batch(Cunder_Module *cunder_module, const Cunder_Array *requests, size_t requests_count, Cunder_Array *out_responses)
+	{
+		if (cunder_module == nullptr || requests == nullptr || requests_count == 0 || out_responses == nullptr)
+			return -1;
+
+		size_t inputs_count = requests[0].length;
+		for (size_t r = 1; r < requests_count; ++r)
+			if (requests[r].length != inputs_count)
+				return -1;
+
+		// per input: the batch size of every request and their total
+		std::vector<std::vector<int64_t>> batch_sizes(inputs_count, std::vector<int64_t>(requests_count, 0));
+		std::vector<int64_t> batch_totals(inputs_count, 0);
+		std::vector<torch::Tensor> outputs;
+
+		try
+		{
+			std::vector<torch::IValue> values;
+			values.resize(inputs_count);
+			std::vector<torch::Tensor> parts(requests_count);
+			for (size_t i = 0; i < inputs_count; ++i)
+			{
+				for (size_t r = 0; r < requests_count; ++r)
+				{
+					const torch::Tensor &tensor = requests[r].data[i].tensor;
+					if (tensor.defined() == false || tensor.dim() < 1)
+						return -1;
+					parts[r] = tensor;
+					batch_sizes[i][r] = tensor.size(0);
+					batch_totals[i] += tensor.size(0);
+				}
+				// a single request is forwarded as is, no concatenation copy
+				values[i] = requests_count == 1 ? parts[0] : torch::cat(parts, 0);
+			}
+
+			if (_cunder_output_tensors(cunder_module->module.forward(values), outputs) == false)
+				return -1;
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			printf("%s\n", e.what());
+			return -1;
+		} catch (const std::exception &e)
+		{
+			printf("%s\n", e.what());
+			return -1;
+		}
+
+		// every output is split using the batch sizes of the inputs with the same batch total, inputs having that
+		// total with other per request sizes make the split ambiguous
+		std::vector<const std::vector<int64_t> *> output_splits(outputs.size(), nullptr);
+		if (requests_count > 1)
+		{
+			for (size_t o = 0; o < outputs.size(); ++o)
+			{
+				for (size_t i = 0; i < inputs_count && outputs[o].dim() > 0; ++i)
+				{
+					if (batch_totals[i] != outputs[o].size(0))
+						continue;
+					if (output_splits[o] != nullptr && *output_splits[o] != batch_sizes[i])
+						return -1;
+					output_splits[o] = &batch_sizes[i];
+				}
+				if (output_splits[o] == nullptr)
+					return -1;
+			}
+		}
+
+		for (size_t r = 0; r < requests_count; ++r)
+			out_responses[r] = cunder_tensor_allocate(outputs.size());
+
+		for (size_t o = 0; o < outputs.size(); ++o)
+		{
+			if (requests_count == 1)
+			{
+				out_responses[0].data[o].tensor = outputs[o];
+				continue;
+			}
+
+			// split_with_sizes returns views into the batched output
+			std::vector<torch::Tensor> chunks = outputs[o].split_with_sizes(*output_splits[o], 0);
+			for (size_t r = 0; r < requests_count; ++r)
+				out_responses[r].data[o].tensor = chunks[r];
+		}
+		return 0;
+	}
+
+	Cunder_OutputBindings *
+	cunder_output_bindings_create(size_t outputs_count)
+	{
+		Cunder_OutputBindings *bindings = new Cunder_OutputBindings{};
+		bindings->outputs.resize(outputs_count);
+		return bindings;
+	}
+
+	int
+	cunder_output_bindings_free(Cunder_OutputBindings *bindings)
+	{
+		if (bindings == nullptr)
+			return -1;
+
+		delete bindings;
+		return 0; // success
+	}
+
+	int
+	cunder_output_bindings_set(Cunder_OutputBindings *bindings, size_t index, void *data, size_t nbytes, Cunder_DType dtype)
+	{
+		if (bindings == nullptr || index >= bindings->outputs.size() || cunder::is_valid_dtype(dtype) == false)
+			return -1;
+
+		Cunder_OutputBindings::binding &binding = bindings->outputs[index];
+		binding.written = false;
+		binding.shape.clear();
+		if (data == nullptr)
+		{
+			binding.buffer = torch::Tensor();
+			return 0;
+		}
+
+		c10::ScalarType scalar_type = cunder::get_libtorch_dtype(dtype);
+		int64_t capacity = (int64_t)(nbytes / c10::elementSize(scalar_type));
+		binding.buffer = torch::from_blob(data, {capacity}, torch::TensorOptions(scalar_type));
+		return 0; // success
+	}
+
+	int64_t
+	cunder_output_bindings_ndim(const Cunder_OutputBindings *bindings, size_t index)
+	{
+		if (bindings == nullptr || index >= bindings->outputs.size() || bindings->outputs[index].written == false)
+			return -1;
+		return (int64_t)bindings->outputs[index].shape.size();
+	}
+
+	void
+	cunder_output_bindings_shape(const Cunder_OutputBindings *bindings, size_t index, int64_t *out_shape)
+	{
+		if (bindings == nullptr || index >= bindings->outputs.size())
+			return;
+
+		int d = 0;
+		for (int64_t size : bindings->outputs[index].shape)
+			out_shape[d++] = size;
+	}
+
+	int
+	cunder_module_forward_into(Cunder_Module *cunder_module, Cunder_Array tensors_array, Cunder_OutputBindings *bindings)
+	{
+		if (cunder_module == nullptr || bindings == nullptr)
+			return -1;
+
+		std::vector<torch::IValue> values;
+		values.resize(tensors_array.length);
+		for (size_t i = 0; i < tensors_array.length; ++i)
+			values[i] = tensors_array.data[i].tensor;
+
+		try
+		{
+			std::vector<torch::Tensor> outputs;
+			if (_cunder_output_tensors(cunder_module->module.forward(values), outputs) == false)
+				return -1;
+
+			// every output is checked against its binding before any buffer is written
+			size_t bound_count = std::min(outputs.size(), bindings->outputs.size());
+			for (size_t i = 0; i < bound_count; ++i)
+			{
+				const torch::Tensor &buffer = bindings->outputs[i].buffer;
+				const torch::Tensor &output = outputs[i];
+				if (buffer.defined() == false)
+					continue;
+				if (output.numel() > buffer.numel() || output.is_quantized() || (output.is_complex() && buffer.is_complex() == false))
+					return -1;
+			}
+
+			for (size_t i = 0; i < bound_count; ++i)
+			{
+				Cunder_OutputBindings::binding &binding = bindings->outputs[i];
+				const torch::Tensor &output = outputs[i];
+				if (binding.buffer.defined() == false)
+					continue;
+
+				binding.written = false;
+				// the output may already live in the bound buffer (in place modules), otherwise a single
+				// copy_ converts the dtype and gathers non contiguous outputs
+				torch::Tensor destination = binding.buffer.narrow(0, 0, output.numel()).view(output.sizes());
+				if (destination.data_ptr() != output.data_ptr() || destination.scalar_type() != output.scalar_type() ||
+					destination.strides() != output.strides())
+					destination.copy_(output);
+
+				binding.shape = output.sizes().vec();
+				binding.written = true;
+			}
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			printf("%s\n", e.what());
+			return -1;
+		} catch (const std::exception &e)
+		{
+			printf("%s\n", e.what());
+			return -1;
+		}
+		return 0; // success
+	}
+
+	// Forward the module and pack its outputs, returns an empty array on failure.
+	inline static Cunder_Array
+	_cunder_module_forward_values(torch::jit::Module &module, std::vector<torch::IValue> values)
+	{
+		std::vector<torch::Tensor> outputs;
+		try
+		{
+			if (_cunder_output_tensors(module.forward(std::move(values)), outputs) == false)
+				return {nullptr, 0};
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			printf("%s\n", e.what());
+			return {nullptr, 0};
+		} catch (const std::exception &e)
+		{
+			printf("%s\n", e.what());
+			return {nullptr, 0};
+		}
+
+		Cunder_Array output_tensors = cunder_tensor_allocate(outputs.size());
+		for (size_t i = 0; i < outputs.size(); ++i)
+			output_tensors.data[i].tensor = std::move(outputs[i]);
+		return output_tensors;
+	}
+
+	// Start the stage threads, every stage closes the next queue once its own is closed and drained.
+	inline static void
+	_cunder_pipeline_start(Cunder_Pipeline *pipeline)
+	{
+		pipeline->preprocess_thread = std::thread([pipeline] {
+			void *request = nullptr;
+			while (pipeline->requests.pop(request))
+			{
+				Cunder_Pipeline::job next{request, {nullptr, 0}};
+				if (pipeline->preprocess(request, &next.tensors, pipeline->user_data) != 0 && next.tensors.data != nullptr)
+				{
+					cunder_array_free(next.tensors);
+					next.tensors = {nullptr, 0};
+				}
+				pipeline->inputs.push(std::move(next));
+			}
+			pipeline->inputs.close();
+		});
+
+		pipeline->forward_thread = std::thread([pipeline] {
+			Cunder_Pipeline::job current;
+			while (pipeline->inputs.pop(current))
+			{
+				Cunder_Array module_outputs{nullptr, 0};
+				if (current.tensors.data != nullptr)
+				{
+					std::vector<torch::IValue> values(current.tensors.length);
+					for (size_t i = 0; i < current.tensors.length; ++i)
+						values[i] = current.tensors.data[i].tensor;
+					cunder_array_free(current.tensors);
+					module_outputs = _cunder_module_forward_values(pipeline->cunder_module->module, std::move(values));
+				}
+				pipeline->outputs.push(Cunder_Pipeline::job{current.request, module_outputs});
+			}
+			pipeline->outputs.close();
+		});
+
+		pipeline->postprocess_thread = std::thread([pipeline] {
+			Cunder_Pipeline::job done;
+			while (pipeline->outputs.pop(done))
+			{
+				pipeline->postprocess(done.request, done.tensors, pipeline->user_data);
+				pipeline->completed_count.fetch_add(1);
+				std::lock_guard<std::mutex> lock(pipeline->flush_mutex);
+				pipeline->flushed.notify_all();
+			}
+		});
+	}
+
+	Cunder_Pipeline *
+	cunder_pipeline_create(
+		Cunder_Module *cunder_module,
+		Cunder_PreprocessCallback preprocess,
+		Cunder_PostprocessCallback postprocess,
+		void *user_data,
+		size_t queue_capacity)
+	{
+		if (cunder_module == nullptr || preprocess == nullptr || postprocess == nullptr)
+			return nullptr;
+
+		if (queue_capacity == 0)
+			queue_capacity = 64;
+		Cunder_Pipeline *pipeline = new Cunder_Pipeline(cunder_module, preprocess, postprocess, user_data, queue_capacity);
+		_cunder_pipeline_start(pipeline);
+		return pipeline;
+	}
+
+	int
+	cunder_pipeline_free(Cunder_Pipeline *pipeline)
+	{
+		if (pipeline == nullptr)
+			return -1;
+
+		delete pipeline;
+		return 0; // success
+	}
+
+	int
+	cunder_pipeline_submit(Cunder_Pipeline *pipeline, void *request)
+	{
+		if (pipeline == nullptr)
+			return -1;
+
+		pipeline->submitted_count.fetch_add(1);
+		if (pipeline->requests.push(std::move(request)) == false)
+		{
+			pipeline->submitted_count.fetch_sub(1);
+			return -1;
+		}
+		return 0; // success
+	}
+
+	int
+	cunder_pipeline_try_submit(Cunder_Pipeline *pipeline, void *request)
+	{
+		if (pipeline == nullptr)
+			return -1;
+
+		pipeline->submitted_count.fetch_add(1);
+		if (pipeline->requests.try_push(std::move(request)) == false)
+		{
+			pipeline->submitted_count.fetch_sub(1);
+			return 1; // full
+		}
+		return 0; // success
+	}
+
+	int
+	cunder_pipeline_flush(Cunder_Pipeline *pipeline)
+	{
+		if (pipeline == nullptr)
+			return -1;
+
+		int64_t target = pipeline->submitted_count.load();
+		std::unique_lock<std::mutex> lock(pipeline->flush_mutex);
+		pipeline->flushed.wait(lock, [pipeline, target] { return pipeline->completed_count.load() >= target; });
+		return 0; // success
+	}
+
+	// Forward a batch of scheduled requests and complete their futures, the mutex must not be held.
+	inline static void
+	_cunder_scheduler_run(Cunder_Scheduler *scheduler, std::vector<Cunder_Scheduler::request> &batch)
+	{
+		std::vector<Cunder_Array> requests(batch.size());
+		std::vector<Cunder_Array> responses(batch.size(), Cunder_Array{nullptr, 0});
+		for (size_t r = 0; r < batch.size(); ++r)
+			requests[r] = batch[r].inputs;
+
+		Cunder_Scheduler::clock::time_point start = Cunder_Scheduler::clock::now();
+		try
+		{
+			if (cunder_module_forward_batch(scheduler->cunder_module, requests.data(), requests.size(), responses.data()) != 0)
+			{
+				// the requests don't batch (mismatched shapes or a failing input), forward them one by one
+				for (size_t r = 0; r < batch.size(); ++r)
+				{
+					std::vector<torch::IValue> values(requests[r].length);
+					for (size_t i = 0; i < requests[r].length; ++i)
+						values[i] = requests[r].data[i].tensor;
+					responses[r] = _cunder_module_forward_values(scheduler->cunder_module->module, std::move(values));
+				}
+			}
+		} catch (const std::exception &e)
+		{
+			// an exception leaving the dispatcher thread would terminate the process, the whole batch fails instead
+			printf("%s\n", e.what());
+			for (Cunder_Array &response : responses)
+			{
+				cunder_array_free(response);
+				response = {nullptr, 0};
+			}
+		}
+		Cunder_Scheduler::clock::time_point end = Cunder_Scheduler::clock::now();
+
+		for (size_t r = 0; r < batch.size(); ++r)
+		{
+			cunder_array_free(batch[r].inputs);
+			batch[r].state->complete(responses[r]);
+		}
+
+		std::lock_guard<std::mutex> lock(scheduler->mutex);
+		const double alpha = 0.2;
+		double forward_ms = std::chrono::duration<double, std::milli>(end - start).count();
+		scheduler->forward_ewma_ms =
+			scheduler->batches_count == 0 ? forward_ms : (1 - alpha) * scheduler->forward_ewma_ms + alpha * forward_ms;
+		scheduler->batch_size_ewma =
+			scheduler->batches_count == 0 ? (double)batch.size() : (1 - alpha) * scheduler->batch_size_ewma + alpha * (double)batch.size();
+		scheduler->batches_count += 1;
+
+		for (const Cunder_Scheduler::request &done : batch)
+		{
+			double latency_ms = std::chrono::duration<double, std::milli>(end - done.submitted_at).count();
+			if (scheduler->latencies_ms.size() < Cunder_Scheduler::latencies_capacity)
+				scheduler->latencies_ms.push_back(latency_ms);
+			else
+				scheduler->latencies_ms[scheduler->latencies_next] = latency_ms;
+			scheduler->latencies_next = (scheduler->latencies_next + 1) % Cunder_Scheduler::latencies_capacity;
+			scheduler->deadline_misses_count += end > done.deadline ? 1 : 0;
+		}
+
+		std::vector<double> latencies = scheduler->latencies_ms;
+		size_t p99_index = (latencies.size() * 99) / 100;
+		std::nth_element(latencies.begin(), latencies.begin() + p99_index, latencies.end());
+		scheduler->p99_latency_ms = latencies[p99_index];
+
+		// AIMD window: halve it when the p99 overshoots the target or when a full batch is already queued (waiting
+		// only delays requests that will batch anyway), grow it while there is headroom, the batches are not full
+		// and the queue is shallow
+		double target_ms = scheduler->config.target_p99_ms;
+		size_t pending_depth = scheduler->pending.size();
+		if (scheduler->p99_latency_ms > target_ms || pending_depth >= scheduler->config.max_batch_size)
+			scheduler->window_ms *= 0.5;
+		else if (
+			scheduler->p99_latency_ms < 0.8 * target_ms && batch.size() < scheduler->config.max_batch_size &&
+			pending_depth < scheduler->config.max_batch_size / 2)
+			scheduler->window_ms += 0.05 * target_ms;
+		double headroom_ms = std::max(0.0, target_ms - scheduler->forward_ewma_ms);
+		scheduler->window_ms = std::min({scheduler->window_ms, scheduler->config.max_window_ms, headroom_ms});
+	}
+
+	inline static void
+	_cunder_scheduler_start(Cunder_Scheduler *scheduler)
+	{
+		scheduler->dispatcher = std::thread([scheduler] {
+			using clock = Cunder_Scheduler::clock;
+			std::vector<Cunder_Scheduler::request> batch;
+			std::unique_lock<std::mutex> lock(scheduler->mutex);
+			while (true)
+			{
+				scheduler->pending_changed.wait(lock, [scheduler] { return scheduler->closed || scheduler->pending.empty() == false; });
+				if (scheduler->pending.empty())
+					return; // closed and drained
+
+				// wait for a fuller batch until the window since the oldest request ends, or until the request with
+				// the earliest deadline (whatever its priority) would miss it given the predicted forward time
+				while (scheduler->closed == false && scheduler->pending.size() < scheduler->config.max_batch_size)
+				{
+					clock::time_point oldest = scheduler->pending.front().submitted_at;
+					clock::time_point earliest_deadline = scheduler->pending.front().deadline;
+					for (const Cunder_Scheduler::request &pending : scheduler->pending)
+					{
+						oldest = std::min(oldest, pending.submitted_at);
+						earliest_deadline = std::min(earliest_deadline, pending.deadline);
+					}
+					double batch_size = (double)std::min(scheduler->pending.size() + 1, scheduler->config.max_batch_size);
+					double predicted_ms = scheduler->forward_ewma_ms * std::max(1.0, batch_size / scheduler->batch_size_ewma);
+
+					auto to_duration = [](double ms) { return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(ms)); };
+					clock::time_point dispatch_at =
+						std::min(oldest + to_duration(scheduler->window_ms), earliest_deadline - to_duration(predicted_ms));
+					if (clock::now() >= dispatch_at)
+						break;
+					size_t pending_count = scheduler->pending.size();
+					scheduler->pending_changed.wait_until(lock, dispatch_at, [scheduler, pending_count] {
+						return scheduler->closed || scheduler->pending.size() != pending_count;
+					});
+					if (scheduler->pending.size() == pending_count)
+						break; // the window ended without new requests
+				}
+
+				// most urgent first, expired requests are dropped if requested
+				batch.clear();
+				clock::time_point now = clock::now();
+				while (scheduler->pending.empty() == false && batch.size() < scheduler->config.max_batch_size)
+				{
+					std::pop_heap(scheduler->pending.begin(), scheduler->pending.end(), &Cunder_Scheduler::less_urgent);
+					Cunder_Scheduler::request next = std::move(scheduler->pending.back());
+					scheduler->pending.pop_back();
+					if (scheduler->config.drop_expired && next.deadline < now)
+					{
+						scheduler->dropped_count += 1;
+						scheduler->deadline_misses_count += 1;
+						cunder_array_free(next.inputs);
+						lock.unlock();
+						next.state->complete({nullptr, 0});
+						lock.lock();
+						continue;
+					}
+					batch.push_back(std::move(next));
+				}
+
+				if (batch.empty())
+					continue;
+				lock.unlock();
+				_cunder_scheduler_run(scheduler, batch);
+				lock.lock();
+			}
+		});
+	}
+
+	Cunder_SchedulerConfig
+	cunder_scheduler_default_config()
+	{
+		Cunder_SchedulerConfig config;
+		config.target_p99_ms = 50;
+		config.max_batch_size = 32;
+		config.max_window_ms = 10;
+		config.queue_capacity = 1024;
+		config.drop_expired = false;
+		return config;
+	}
+
+	Cunder_Scheduler *
+	cunder_scheduler_create(Cunder_Module *cunder_module, const Cunder_SchedulerConfig *config)
+	{
+		Cunder_SchedulerConfig scheduler_config = config != nullptr ? *config : cunder_scheduler_default_config();
+		if (cunder_module == nullptr || scheduler_config.target_p99_ms <= 0 || scheduler_config.max_batch_size == 0 ||
+			scheduler_config.max_window_ms < 0)
+			return nullptr;
+
+		Cunder_Scheduler *scheduler = new Cunder_Scheduler(cunder_module, scheduler_config);
+		_cunder_scheduler_start(scheduler);
+		return scheduler;
+	}
+
+	int
+	cunder_scheduler_free(Cunder_Scheduler *scheduler)
+	{
+		if (scheduler == nullptr)
+			return -1;
+
+		delete scheduler;
+		return 0; // success
+	}
+
+	Cunder_Future *
+	cunder_scheduler_submit(Cunder_Scheduler *scheduler, Cunder_Array tensors_array, double deadline_ms, int priority)
+	{
+		if (scheduler == nullptr)
+			return nullptr;
+
+		Cunder_Scheduler::clock::time_point now = Cunder_Scheduler::clock::now();
+		double relative_deadline_ms = deadline_ms > 0 ? deadline_ms : scheduler->config.target_p99_ms;
+		Cunder_Scheduler::request request;
+		request.submitted_at = now;
+		request.deadline =
+			now + std::chrono::duration_cast<Cunder_Scheduler::clock::duration>(std::chrono::duration<double, std::milli>(relative_deadline_ms));
+		request.priority = priority;
+
+		// the inputs are kept by reference count, the caller may free its array right away
+		request.inputs = cunder_tensor_allocate(tensors_array.length);
+		for (size_t i = 0; i < tensors_array.length; ++i)
+			request.inputs.data[i].tensor = tensors_array.data[i].tensor;
+
+		Cunder_Future *future = new Cunder_Future{std::make_shared<cunder::future_state>()};
+		future->state->handle = future;
+		request.state = future->state;
+
+		{
+			std::lock_guard<std::mutex> lock(scheduler->mutex);
+			if (scheduler->closed || (scheduler->config.queue_capacity > 0 && scheduler->pending.size() >= scheduler->config.queue_capacity))
+			{
+				scheduler->rejected_count += 1;
+				cunder_array_free(request.inputs);
+				delete future;
+				return nullptr;
+			}
+			scheduler->requests_count += 1;
+			scheduler->pending.push_back(std::move(request));
+			std::push_heap(scheduler->pending.begin(), scheduler->pending.end(), &Cunder_Scheduler::less_urgent);
+		}
+		scheduler->pending_changed.notify_one();
+		return future;
+	}
+
+	int
+	cunder_scheduler_stats(Cunder_Scheduler *scheduler, Cunder_SchedulerStats *out_stats)
+	{
+		if (scheduler == nullptr || out_stats == nullptr)
+			return -1;
+
+		std::lock_guard<std::mutex> lock(scheduler->mutex);
+		out_stats->requests_count = scheduler->requests_count;
+		out_stats->batches_count = scheduler->batches_count;
+		out_stats->deadline_misses_count = scheduler->deadline_misses_count;
+		out_stats->dropped_count = scheduler->dropped_count;
+		out_stats->rejected_count = scheduler->rejected_count;
+		out_stats->pending_count = (int64_t)scheduler->pending.size();
+		out_stats->batch_size_ewma = scheduler->batch_size_ewma;
+		out_stats->forward_ewma_ms = scheduler->forward_ewma_ms;
+		out_stats->p99_latency_ms = scheduler->p99_latency_ms;
+		out_stats->window_ms = scheduler->window_ms;
+		return 0; // success
+	}
+
+	Cunder_SessionOptions
+	cunder_session_default_options()
+	{
+		Cunder_SessionOptions options;
+		options.inference_mode = true;
+		options.grad_enabled = false;
+		options.jit_optimize = true;
+		return options;
+	}
+
+	Cunder_Session *
+	cunder_session_create(const Cunder_SessionOptions *options)
+	{
+		Cunder_SessionOptions session_options = options != nullptr ? *options : cunder_session_default_options();
+		return new Cunder_Session{session_options};
+	}
+
+	int
+	cunder_session_free(Cunder_Session *session)
+	{
+		if (session == nullptr)
+			return -1;
+
+		delete session;
+		return 0; // success
+	}
+
+	Cunder_Array
+	cunder_session_forward(const Cunder_Session *session, Cunder_Module *cunder_module, Cunder_Array tensors_array)
+	{
+		if (session == nullptr || cunder_module == nullptr)
+			return {nullptr, 0};
+
+		std::vector<torch::IValue> values;
+		values.resize(tensors_array.length);
+		for (size_t i = 0; i < tensors_array.length; ++i)
+			values[i] = tensors_array.data[i].tensor;
+
+		cunder::session_guard guard(session->options);
+		return _cunder_module_forward_values(cunder_module->module, std::move(values));
+	}
+
+	Cunder_ResultCache *
+	cunder_result_cache_create(Cunder_Module *cunder_module, size_t max_bytes)
+	{
+		if (cunder_module == nullptr || max_bytes == 0)
+			return nullptr;
+
+		Cunder_ResultCache *cache = new Cunder_ResultCache{};
+		cache->cunder_module = cunder_module;
+		cache->max_bytes = max_bytes;
+		return cache;
+	}
+
+	int
+	cunder_result_cache_free(Cunder_ResultCache *cache)
+	{
+		if (cache == nullptr)
+			return -1;
+
+		delete cache;
+		return 0; // success
+	}
+
+	// Key of the inputs: dtype, shape and bytes of every tensor.
+	inline static uint64_t
+	_cunder_result_cache_key(const std::vector<torch::Tensor> &inputs)
+	{
+		uint64_t key = inputs.size();
+		for (const torch::Tensor &input : inputs)
+		{
+			int64_t dtype = (int64_t)input.scalar_type();
+			key = cunder::hash_bytes(&dtype, sizeof(dtype), key);
+			key = cunder::hash_bytes(input.sizes().data(), input.dim() * sizeof(int64_t), key);
+			key = cunder::hash_bytes(input.data_ptr(), input.nbytes(), key);
+		}
+		return key;
+	}
+
+	inline static bool
+	_cunder_result_cache_match(const std::vector<torch::Tensor> &a, const std::vector<torch::Tensor> &b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			if (a[i].scalar_type() != b[i].scalar_type() || a[i].sizes() != b[i].sizes() ||
+				memcmp(a[i].data_ptr(), b[i].data_ptr(), a[i].nbytes()) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	inline static Cunder_Array
+	_cunder_result_cache_outputs(const std::vector<torch::Tensor> &outputs)
+	{
+		Cunder_Array output_tensors = cunder_tensor_allocate(outputs.size());
+		for (size_t i = 0; i < outputs.size(); ++i)
+			output_tensors.data[i].tensor = outputs[i];
+		return output_tensors;
+	}
+
+	Cunder_Array
+	cunder_result_cache_forward(Cunder_ResultCache *cache, Cunder_Array tensors_array)
+	{
+		if (cache == nullptr)
+			return {nullptr, 0};
+
+		std::vector<torch::Tensor> inputs(tensors_array.length);
+		for (size_t i = 0; i < tensors_array.length; ++i)
+		{
+			if (tensors_array.data[i].tensor.defined() == false)
+				return {nullptr, 0};
+			inputs[i] = tensors_array.data[i].tensor.contiguous();
+		}
+		uint64_t key = _cunder_result_cache_key(inputs);
+
+		{
+			std::lock_guard<std::mutex> lock(cache->mutex);
+			auto found = cache->index.find(key);
+			if (found != cache->index.end() && _cunder_result_cache_match(found->second->inputs, inputs))
+			{
+				cache->hits += 1;
+				cache->entries.splice(cache->entries.begin(), cache->entries, found->second);
+				return _cunder_result_cache_outputs(found->second->outputs);
+			}
+			cache->misses += 1;
+		}
+
+		// the forward runs unlocked, concurrent misses of the same inputs both compute it
+		std::vector<torch::IValue> values(inputs.begin(), inputs.end());
+		std::vector<torch::Tensor> outputs;
+		try
+		{
+			if (_cunder_output_tensors(cache->cunder_module->module.forward(values), outputs) == false)
+				return {nullptr, 0};
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			return {nullptr, 0};
+		} catch (const std::exception &e)
+		{
+			printf("%s\n", e.what());
+			return {nullptr, 0};
+		}
+
+		Cunder_ResultCache::entry entry{key, {}, {}, 0};
+		for (const torch::Tensor &input : inputs)
+		{
+			// inputs viewing caller memory are copied, the caller may reuse it
+			entry.inputs.push_back(input.clone());
+			entry.nbytes += input.nbytes();
+		}
+		for (const torch::Tensor &output : outputs)
+		{
+			// same for the outputs returning an input or a view of one
+			bool aliases_input = std::any_of(
+				tensors_array.data, tensors_array.data + tensors_array.length, [&](const Cunder_Tensor &input) { return output.is_alias_of(input.tensor); });
+			entry.outputs.push_back(aliases_input ? output.clone() : output);
+			entry.nbytes += entry.outputs.back().storage().nbytes();
+		}
+
+		if (entry.nbytes <= cache->max_bytes)
+		{
+			std::lock_guard<std::mutex> lock(cache->mutex);
+			auto found = cache->index.find(key);
+			if (found != cache->index.end())
+			{
+				cache->nbytes -= found->second->nbytes;
+				cache->entries.erase(found->second);
+				cache->index.erase(found);
+			}
+			while (cache->entries.empty() == false && cache->nbytes + entry.nbytes > cache->max_bytes)
+			{
+				const Cunder_ResultCache::entry &oldest = cache->entries.back();
+				cache->nbytes -= oldest.nbytes;
+				cache->index.erase(oldest.key);
+				cache->entries.pop_back();
+				cache->evictions += 1;
+			}
+			cache->nbytes += entry.nbytes;
+			cache->entries.push_front(std::move(entry));
+			cache->index[key] = cache->entries.begin();
+		}
+		return _cunder_result_cache_outputs(outputs);
+	}
+
+	int
+	cunder_result_cache_stats(Cunder_ResultCache *cache, Cunder_ResultCacheStats *out_stats)
+	{
+		if (cache == nullptr || out_stats == nullptr)
+			return -1;
+
+		std::lock_guard<std::mutex> lock(cache->mutex);
+		out_stats->hits = cache->hits;
+		out_stats->misses = cache->misses;
+		out_stats->evictions = cache->evictions;
+		out_stats->entries_count = (int64_t)cache->entries.size();
+		out_stats->bytes = (int64_t)cache->nbytes;
+		return 0; // success
+	}
+
+	void
+	cunder_result_cache_clear(Cunder_ResultCache *cache)
+	{
+		if (cache == nullptr)
+			return;
+
+		std::lock_guard<std::mutex> lock(cache->mutex);
+		cache->entries.clear();
+		cache->index.clear();
+		cache->nbytes = 0;
+	}
+
+	// Bytes of the distinct storages of the module parameters and buffers.
+	inline static int64_t
+	_cunder_module_footprint(const torch::jit::Module &module)
+	{
+		std::unordered_set<const void *> storages;
+		int64_t footprint = 0;
+		auto account = [&](const torch::Tensor &tensor) {
+			if (tensor.defined() && tensor.has_storage() && storages.insert(tensor.storage().data()).second)
+				footprint += (int64_t)tensor.storage().nbytes();
+		};
+		for (const torch::Tensor &parameter : module.parameters())
+			account(parameter);
+		for (const torch::Tensor &buffer : module.buffers())
+			account(buffer);
+		return footprint;
+	}
+
+	// Unload the least recently used unreferenced modules until the budget is met, the mutex must be held.
+	inline static void
+	_cunder_model_registry_evict(Cunder_ModelRegistry *registry)
+	{
+		while (registry->resident_bytes > (int64_t)registry->memory_budget_bytes)
+		{
+			Cunder_ModelRegistry::entry *oldest = nullptr;
+			for (auto &model : registry->models)
+			{
+				Cunder_ModelRegistry::entry &candidate = model.second;
+				if (candidate.cunder_module != nullptr && candidate.references_count == 0 &&
+					(oldest == nullptr || candidate.last_use < oldest->last_use))
+					oldest = &candidate;
+			}
+			if (oldest == nullptr)
+				return; // every resident module is in use
+
+			delete oldest->cunder_module;
+			oldest->cunder_module = nullptr;
+			registry->resident_bytes -= oldest->footprint_bytes;
+			registry->evictions_count += 1;
+		}
+	}
+
+	inline static std::map<std::pair<std::string, int64_t>, Cunder_ModelRegistry::entry>::iterator
+	_cunder_model_registry_find(Cunder_ModelRegistry *registry, const char *name, int64_t version)
+	{
+		if (version >= 0)
+			return registry->models.find({name, version});
+
+		// latest version: the last entry of the name
+		auto after = registry->models.lower_bound({name, INT64_MAX});
+		if (after != registry->models.end() && after->first.first == name)
+			return after;
+		if (after == registry->models.begin())
+			return registry->models.end();
+		--after;
+		return after->first.first == name ? after : registry->models.end();
+	}
+
+	Cunder_ModelRegistry *
+	cunder_model_registry_create(size_t memory_budget_bytes)
+	{
+		Cunder_ModelRegistry *registry = new Cunder_ModelRegistry{};
+		registry->memory_budget_bytes = memory_budget_bytes > 0 ? memory_budget_bytes : SIZE_MAX;
+		return registry;
+	}
+
+	int
+	cunder_model_registry_free(Cunder_ModelRegistry *registry)
+	{
+		if (registry == nullptr)
+			return -1;
+
+		delete registry;
+		return 0; // success
+	}
+
+	int
+	cunder_model_registry_register(Cunder_ModelRegistry *registry, const char *name, int64_t version, const char *filename)
 	{
-		return tensor->tensor.numel();
+		if (registry == nullptr || name == nullptr || version < 0 || filename == nullptr)
+			return -1;
+
+		std::lock_guard<std::mutex> lock(registry->mutex);
+		auto inserted = registry->models.emplace(std::make_pair(std::string(name), version), Cunder_ModelRegistry::entry{});
+		if (inserted.second == false)
+			return -1;
+		inserted.first->second.filename = filename;
+		return 0; // success
+	}
+
+	int
+	cunder_model_registry_unregister(Cunder_ModelRegistry *registry, const char *name, int64_t version)
+	{
+		if (registry == nullptr || name == nullptr)
+			return -1;
+
+		std::lock_guard<std::mutex> lock(registry->mutex);
+		auto found = _cunder_model_registry_find(registry, name, version);
+		if (found == registry->models.end() || found->second.references_count > 0)
+			return -1;
+
+		if (found->second.cunder_module != nullptr)
+		{
+			delete found->second.cunder_module;
+			registry->resident_bytes -= found->second.footprint_bytes;
+		}
+		registry->models.erase(found);
+		return 0; // success
+	}
+
+	Cunder_Module *
+	cunder_model_registry_acquire(Cunder_ModelRegistry *registry, const char *name, int64_t version)
+	{
+		if (registry == nullptr || name == nullptr)
+			return nullptr;
+
+		std::unique_lock<std::mutex> lock(registry->mutex);
+		auto found = _cunder_model_registry_find(registry, name, version);
+		if (found == registry->models.end())
+			return nullptr;
+
+		// referenced entries are never evicted nor erased, the reference keeps `model` valid while unlocked
+		Cunder_ModelRegistry::entry &model = found->second;
+		model.references_count += 1;
+		registry->loaded.wait(lock, [&model] { return model.loading == false; });
+
+		if (model.cunder_module == nullptr)
+		{
+			// loaded unlocked, concurrent acquires of this model wait for it
+			model.loading = true;
+			std::string filename = model.filename;
+			lock.unlock();
+			Cunder_Module *cunder_module = cunder_module_load(filename.c_str());
+			if (cunder_module != nullptr)
+				cunder_module->module.eval();
+			lock.lock();
+			model.loading = false;
+			registry->loaded.notify_all();
+
+			if (cunder_module == nullptr)
+			{
+				model.references_count -= 1;
+				return nullptr;
+			}
+			model.cunder_module = cunder_module;
+			model.footprint_bytes = _cunder_module_footprint(cunder_module->module);
+			registry->resident_bytes += model.footprint_bytes;
+			registry->loads_count += 1;
+			_cunder_model_registry_evict(registry);
+		}
+
+		model.last_use = ++registry->clock;
+		return model.cunder_module;
+	}
+
+	int
+	cunder_model_registry_release(Cunder_ModelRegistry *registry, Cunder_Module *cunder_module)
+	{
+		if (registry == nullptr || cunder_module == nullptr)
+			return -1;
+
+		std::lock_guard<std::mutex> lock(registry->mutex);
+		for (auto &model : registry->models)
+		{
+			Cunder_ModelRegistry::entry &entry = model.second;
+			if (entry.cunder_module != cunder_module || entry.references_count == 0)
+				continue;
+
+			entry.references_count -= 1;
+			entry.last_use = ++registry->clock;
+			_cunder_model_registry_evict(registry);
+			return 0; // success
+		}
+		return -1;
 	}
 
 	int64_t
-	cunder_tensor_dim_size(const Cunder_Tensor *tensor, int64_t dim)
+	cunder_model_registry_footprint(Cunder_ModelRegistry *registry, const char *name, int64_t version)
 	{
-		return tensor->tensor.size(dim);
+		if (registry == nullptr || name == nullptr)
+			return -1;
+
+		std::lock_guard<std::mutex> lock(registry->mutex);
+		auto found = _cunder_model_registry_find(registry, name, version);
+		if (found == registry->models.end() || found->second.cunder_module == nullptr)
+			return -1;
+		return found->second.footprint_bytes;
 	}
 
-	const bool *
-	cunder_tensor_accessor_b(const Cunder_Tensor *tensor)
+	int
+	cunder_model_registry_stats(Cunder_ModelRegistry *registry, Cunder_ModelRegistryStats *out_stats)
 	{
-		return tensor->tensor.data_ptr<bool>();
+		if (registry == nullptr || out_stats == nullptr)
+			return -1;
+
+		std::lock_guard<std::mutex> lock(registry->mutex);
+		out_stats->models_count = (int64_t)registry->models.size();
+		out_stats->resident_count = 0;
+		for (const auto &model : registry->models)
+			out_stats->resident_count += model.second.cunder_module != nullptr ? 1 : 0;
+		out_stats->resident_bytes = registry->resident_bytes;
+		out_stats->loads_count = registry->loads_count;
+		out_stats->evictions_count = registry->evictions_count;
+		return 0; // success
 	}
 
-	const uint8_t *
-	cunder_tensor_accessor_u8(const Cunder_Tensor *tensor)
+	Cunder_ModulePool *
+	cunder_module_pool_create(Cunder_Module *cunder_module, size_t workers_count, size_t queue_capacity)
 	{
-		return tensor->tensor.data_ptr<uint8_t>();
+		if (cunder_module == nullptr)
+			return nullptr;
+
+		if (workers_count == 0)
+			workers_count = std::max(1u, std::thread::hardware_concurrency());
+		if (queue_capacity == 0)
+			queue_capacity = 1024;
+
+		return new Cunder_ModulePool(cunder_module, workers_count, queue_capacity);
 	}
 
-	const int8_t *
-	cunder_tensor_accessor_i8(const Cunder_Tensor *tensor)
+	int
+	cunder_module_pool_free(Cunder_ModulePool *pool)
 	{
-		return tensor->tensor.data_ptr<int8_t>();
+		if (pool == nullptr)
+			return -1;
+
+		delete pool;
+		return 0; // success
 	}
 
-	const int16_t *
-	cunder_tensor_accessor_i16(const Cunder_Tensor *tensor)
+	size_t
+	cunder_module_pool_workers_count(const Cunder_ModulePool *pool)
 	{
-		return tensor->tensor.data_ptr<int16_t>();
+		if (pool == nullptr)
+			return 0;
+		return pool->workers.size();
 	}
 
-	const int32_t *
-	cunder_tensor_accessor_i32(const Cunder_Tensor *tensor)
+	int
+	cunder_module_pool_set_affinity(Cunder_ModulePool *pool, const int *cpus, size_t cpus_count)
 	{
-		return tensor->tensor.data_ptr<int32_t>();
+		if (pool == nullptr)
+			return -1;
+
+		for (std::thread &worker : pool->workers)
+			if (cunder::set_thread_affinity(worker.native_handle(), cpus, cpus_count) == false)
+				return -1;
+		return 0; // success
 	}
 
-	const int64_t *
-	cunder_tensor_accessor_i64(const Cunder_Tensor *tensor)
+	// Queue a forward on the pool, `done` receives the outputs on the worker thread.
+	inline static bool
+	_cunder_module_pool_push(Cunder_ModulePool *pool, Cunder_Array tensors_array, std::function<void(Cunder_Array)> done)
 	{
-		return tensor->tensor.data_ptr<int64_t>();
+		// the inputs are captured by reference count, the caller may free its array right away
+		std::vector<torch::IValue> values;
+		values.resize(tensors_array.length);
+		for (size_t i = 0; i < tensors_array.length; ++i)
+			values[i] = tensors_array.data[i].tensor;
+
+		Cunder_Module *cunder_module = pool->cunder_module;
+		std::function<void()> job = [cunder_module, values = std::move(values), done = std::move(done)]() mutable {
+			done(_cunder_module_forward_values(cunder_module->module, std::move(values)));
+		};
+		return pool->jobs.push(std::move(job));
 	}
 
-	const float *
-	cunder_tensor_accessor_f32(const Cunder_Tensor *tensor)
+	int
+	cunder_module_pool_submit(Cunder_ModulePool *pool, Cunder_Array tensors_array, Cunder_ForwardCallback callback, void *user_data)
 	{
-		return tensor->tensor.data_ptr<float>();
+		if (pool == nullptr || callback == nullptr)
+			return -1;
+
+		if (_cunder_module_pool_push(pool, tensors_array, [callback, user_data](Cunder_Array outputs) { callback(outputs, user_data); }) == false)
+			return -1;
+		return 0; // success
 	}
 
-	const double *
-	cunder_tensor_accessor_f64(const Cunder_Tensor *tensor)
+	Cunder_Array
+	cunder_module_pool_forward(Cunder_ModulePool *pool, Cunder_Array tensors_array)
 	{
-		return tensor->tensor.data_ptr<double>();
+		// a worker waiting on its own pool would wait for itself
+		if (pool == nullptr || Cunder_ModulePool::current() == pool)
+			return {nullptr, 0};
+
+		std::promise<Cunder_Array> result;
+		auto on_done = [](Cunder_Array outputs, void *user_data) { ((std::promise<Cunder_Array> *)user_data)->set_value(outputs); };
+		if (cunder_module_pool_submit(pool, tensors_array, on_done, &result) != 0)
+			return {nullptr, 0};
+		return result.get_future().get();
 	}
 
-	Cunder_Module *
-	cunder_module_load(const char *filename)
+	Cunder_Future *
+	cunder_module_pool_forward_async(Cunder_ModulePool *pool, Cunder_Array tensors_array)
 	{
-		torch::jit::Module module;
+		if (pool == nullptr)
+			return nullptr;
 
-		try
+		Cunder_Future *future = new Cunder_Future{std::make_shared<cunder::future_state>()};
+		future->state->handle = future;
+		std::shared_ptr<cunder::future_state> state = future->state;
+		if (_cunder_module_pool_push(pool, tensors_array, [state](Cunder_Array outputs) { state->complete(outputs); }) == false)
 		{
-			module = torch::jit::load(filename);
-		} catch (const c10::Error &e)
-		{
-			printf("%s\n", e.msg().c_str());
-			printf("%s\n", e.what());
+			delete future;
 			return nullptr;
 		}
-
-		Cunder_Module *cunder_module = new Cunder_Module{module};
-		return cunder_module;
+		return future;
 	}
 
-	void
-	cunder_module_dump(const Cunder_Module *module, bool print_method_bodies, bool print_attr_values, bool print_param_values)
+	bool
+	cunder_future_poll(const Cunder_Future *future)
 	{
-		if (module == nullptr)
-			return;
+		if (future == nullptr)
+			return false;
 
-		module->module.dump(print_method_bodies, print_attr_values, print_param_values);
+		return future->state->done.load(std::memory_order_acquire);
 	}
 
-	void
-	cunder_module_eval(Cunder_Module *cunder_module)
+	int
+	cunder_future_wait(Cunder_Future *future, int64_t timeout_ms)
 	{
-		cunder_module->module.eval();
+		if (future == nullptr)
+			return -1;
+
+		cunder::future_state &state = *future->state;
+		if (state.done.load(std::memory_order_acquire))
+			return 0;
+
+		std::unique_lock<std::mutex> lock(state.mutex);
+		auto is_done = [&state] { return state.done.load(std::memory_order_acquire); };
+		if (timeout_ms < 0)
+		{
+			state.done_condition.wait(lock, is_done);
+			return 0;
+		}
+		return state.done_condition.wait_for(lock, std::chrono::milliseconds(timeout_ms), is_done) ? 0 : 1;
 	}
 
-	size_t
-	cunder_module_input_num(Cunder_Module *cunder_module)
+	Cunder_Array
+	cunder_future_get(Cunder_Future *future)
 	{
-		return cunder_module->module.get_method("forward").num_inputs() - 1; // remove self argument
+		if (cunder_future_wait(future, -1) != 0)
+			return {nullptr, 0};
+
+		std::lock_guard<std::mutex> lock(future->state->mutex);
+		Cunder_Array outputs = future->state->outputs;
+		future->state->outputs = {nullptr, 0};
+		return outputs;
 	}
 
-	Cunder_Array
-	cunder_module_forward(Cunder_Module *cunder_module, Cunder_Array tensors_array)
+	int
+	cunder_future_set_callback(Cunder_Future *future, Cunder_FutureCallback callback, void *user_data)
 	{
-		std::vector<torch::IValue> values;
-		values.resize(tensors_array.length);
-		for (size_t i = 0; i < tensors_array.length; ++i)
-			values[i] = tensors_array.data[i].tensor;
-		auto output = cunder_module->module.forward(values);
-		if (output.isTensor())
+		if (future == nullptr)
+			return -1;
+
+		cunder::future_state &state = *future->state;
 		{
-			auto output_tensor = (Cunder_Tensor *)malloc(sizeof(Cunder_Tensor));
-			::new (output_tensor) Cunder_Tensor{output.toTensor()};
-			return Cunder_Array{output_tensor, 1};
+			std::lock_guard<std::mutex> lock(state.mutex);
+			if (state.done.load(std::memory_order_acquire) == false)
+			{
+				state.callback = callback;
+				state.callback_data = user_data;
+				return 0;
+			}
 		}
-		else if (output.isTensorList())
+
+		// already completed, call it right away
+		if (callback != nullptr)
+			callback(future, user_data);
+		return 0;
+	}
+
+	int
+	cunder_future_eventfd(Cunder_Future *future)
+	{
+#ifdef __linux__
+		if (future == nullptr)
+			return -1;
+
+		cunder::future_state &state = *future->state;
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (state.event_fd < 0)
 		{
-			auto output_tensor_list = output.toTensorList();
-			size_t output_count = output_tensor_list.size();
-			auto output_tensors = (Cunder_Tensor *)malloc(sizeof(Cunder_Tensor) * output_count);
-			for (size_t i = 0; i < output_count; ++i)
-				::new (&output_tensors[i]) Cunder_Tensor{output_tensor_list[i]};
-			return Cunder_Array{output_tensors, output_count};
+			state.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (state.done.load(std::memory_order_acquire))
+				state._signal_event_fd();
 		}
-		else if (output.isTuple() && output.toTuple()->elements().empty() == false && output.toTuple()->elements()[0].isTensor())
+		return state.event_fd;
+#else
+		(void)future;
+		return -1;
+#endif // __linux__
+	}
+
+	int
+	cunder_future_free(Cunder_Future *future)
+	{
+		if (future == nullptr)
+			return -1;
+
 		{
-			auto output_tensor_list = output.toTuple()->elements();
-			size_t output_count = output_tensor_list.size();
-			auto output_tensors = (Cunder_Tensor *)malloc(sizeof(Cunder_Tensor) * output_count);
-			for (size_t i = 0; i < output_count; ++i)
-				::new (&output_tensors[i]) Cunder_Tensor{output_tensor_list[i].toTensor()};
-			return Cunder_Array{output_tensors, output_count};
+			// the worker may still hold the state, detach the handle from it and let a running callback
+			// finish with it, unless the callback is the one freeing it
+			cunder::future_state &state = *future->state;
+			std::unique_lock<std::mutex> lock(state.mutex);
+			state.handle = nullptr;
+			state.callback = nullptr;
+			if (state.callback_thread != std::this_thread::get_id())
+				state.done_condition.wait(lock, [&state] { return state.callback_running == false; });
+#ifdef __linux__
+			if (future->state->event_fd >= 0)
+				close(future->state->event_fd);
+#endif // __linux__
+			future->state->event_fd = -1;
 		}
-		AT_ASSERT(false, "The module return type is not supported, got kind: ", output.tagKind());
-		return {nullptr, 0};
+		delete future;
+		return 0; // success
 	}
 
 	void
 	cunder_module_load_allocated(const char *filename, void *module_void)
 	{
 		torch::jit::Module module;
+		cunder::last_error().clear();
 
 		try
 		{
 			module = torch::jit::load(filename);
 		} catch (const c10::Error &e)
 		{
-			printf("%s\n", e.msg().c_str());
-			printf("%s\n", e.what());
+			cunder::last_error() = e.what_without_backtrace();
 			return;
 		}
 
@@ -518,6 +4467,203 @@ extern "C"
 		cunder_module->module = module;
 	}
 
+	Cunder_Profiler *
+	cunder_profiler_start(bool record_shapes, bool profile_memory)
+	{
+		try
+		{
+			torch::profiler::impl::ProfilerConfig config(torch::profiler::impl::ProfilerState::CPU, record_shapes, profile_memory);
+			torch::autograd::profiler::enableProfilerLegacy(config);
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			printf("%s\n", e.what());
+			return nullptr;
+		}
+
+		Cunder_Profiler *profiler = new Cunder_Profiler{};
+		profiler->running = true;
+		return profiler;
+	}
+
+	// Aggregate the profiled ranges by operator name, each thread keeps a stack of the open ranges.
+	inline static void
+	_cunder_profiler_aggregate(Cunder_Profiler *profiler)
+	{
+		using torch::autograd::profiler::EventKind;
+		using torch::autograd::profiler::LegacyEvent;
+
+		struct open_range
+		{
+			const LegacyEvent *push;
+			double children_us;
+			int64_t memory_bytes;
+		};
+
+		std::unordered_map<std::string, size_t> op_index;
+		auto find_op = [&](const char *name) -> Cunder_Profiler::op & {
+			auto inserted = op_index.emplace(name, profiler->ops.size());
+			if (inserted.second)
+			{
+				profiler->ops.emplace_back();
+				profiler->ops.back().name = name;
+			}
+			return profiler->ops[inserted.first->second];
+		};
+
+		for (const std::vector<LegacyEvent> &thread_events : profiler->events)
+		{
+			std::vector<open_range> stack;
+			for (const LegacyEvent &event : thread_events)
+			{
+				switch (event.kind())
+				{
+				case EventKind::PushRange:
+					stack.push_back({&event, 0, 0});
+					break;
+
+				case EventKind::PopRange:
+				{
+					// pops are matched by their record function handle
+					auto range = std::find_if(stack.rbegin(), stack.rend(), [&](const open_range &open) { return open.push->handle() == event.handle(); });
+					if (range == stack.rend())
+						break;
+
+					double elapsed_us = range->push->cpuElapsedUs(event);
+					Cunder_Profiler::op &op = find_op(range->push->name());
+					op.calls_count += 1;
+					op.cpu_time_us += elapsed_us;
+					op.self_cpu_time_us += elapsed_us - range->children_us;
+					op.cpu_memory_bytes += range->memory_bytes;
+
+					stack.erase(std::next(range).base());
+					if (stack.empty() == false)
+						stack.back().children_us += elapsed_us;
+					break;
+				}
+
+				case EventKind::MemoryAlloc:
+					if (stack.empty() == false && event.cpuMemoryUsage() > 0)
+						stack.back().memory_bytes += event.cpuMemoryUsage();
+					break;
+
+				default:
+					break;
+				}
+			}
+		}
+
+		std::sort(profiler->ops.begin(), profiler->ops.end(), [](const Cunder_Profiler::op &a, const Cunder_Profiler::op &b) {
+			return a.self_cpu_time_us > b.self_cpu_time_us;
+		});
+	}
+
+	int
+	cunder_profiler_stop(Cunder_Profiler *profiler)
+	{
+		if (profiler == nullptr || profiler->running == false)
+			return -1;
+
+		try
+		{
+			profiler->events = torch::autograd::profiler::disableProfilerLegacy();
+		} catch (const c10::Error &e)
+		{
+			printf("%s\n", e.msg().c_str());
+			printf("%s\n", e.what());
+			return -1;
+		}
+		profiler->running = false;
+		_cunder_profiler_aggregate(profiler);
+		return 0; // success
+	}
+
+	int
+	cunder_profiler_free(Cunder_Profiler *profiler)
+	{
+		if (profiler == nullptr)
+			return -1;
+
+		if (profiler->running)
+			cunder_profiler_stop(profiler);
+		delete profiler;
+		return 0; // success
+	}
+
+	size_t
+	cunder_profiler_ops_count(const Cunder_Profiler *profiler)
+	{
+		return profiler->ops.size();
+	}
+
+	int
+	cunder_profiler_op(const Cunder_Profiler *profiler, size_t i, Cunder_ProfilerOp *out_op)
+	{
+		if (profiler == nullptr || out_op == nullptr || i >= profiler->ops.size())
+			return -1;
+
+		const Cunder_Profiler::op &op = profiler->ops[i];
+		out_op->name = op.name.c_str();
+		out_op->calls_count = op.calls_count;
+		out_op->cpu_time_us = op.cpu_time_us;
+		out_op->self_cpu_time_us = op.self_cpu_time_us;
+		out_op->cpu_memory_bytes = op.cpu_memory_bytes;
+		return 0; // success
+	}
+
+	int
+	cunder_profiler_export_chrome_trace(const Cunder_Profiler *profiler, const char *filename)
+	{
+		if (profiler == nullptr || profiler->running || filename == nullptr)
+			return -1;
+
+		std::ofstream out(filename);
+		if (out.is_open() == false)
+			return -1;
+
+		std::vector<torch::autograd::profiler::LegacyEvent *> events;
+		for (const auto &thread_events : profiler->events)
+			for (const auto &event : thread_events)
+				events.push_back(const_cast<torch::autograd::profiler::LegacyEvent *>(&event));
+		torch::autograd::profiler::writeProfilerEventsToStream(out, events);
+		return out.good() ? 0 : -1;
+	}
+
+	int
+	cunder_profiler_write_summary(const Cunder_Profiler *profiler, const char *filename)
+	{
+		if (profiler == nullptr || profiler->running)
+			return -1;
+
+		FILE *out = filename != nullptr ? fopen(filename, "w") : stdout;
+		if (out == nullptr)
+			return -1;
+
+		double total_us = 0;
+		for (const Cunder_Profiler::op &op : profiler->ops)
+			total_us += op.self_cpu_time_us;
+
+		fprintf(out, "%-48s %10s %14s %8s %14s %14s %14s\n", "Name", "Calls", "Self CPU (us)", "Self %", "CPU total (us)", "CPU avg (us)", "Memory (B)");
+		for (const Cunder_Profiler::op &op : profiler->ops)
+		{
+			fprintf(
+				out,
+				"%-48.48s %10lld %14.1f %7.2f%% %14.1f %14.1f %14lld\n",
+				op.name.c_str(),
+				(long long)op.calls_count,
+				op.self_cpu_time_us,
+				total_us > 0 ? 100.0 * op.self_cpu_time_us / total_us : 0.0,
+				op.cpu_time_us,
+				op.calls_count > 0 ? op.cpu_time_us / op.calls_count : 0.0,
+				(long long)op.cpu_memory_bytes);
+		}
+		fprintf(out, "Self CPU time total: %.1f us\n", total_us);
+
+		if (out != stdout)
+			fclose(out);
+		return 0; // success
+	}
+
 	void
 	cunder_tensor_print_attributes(Cunder_Tensor *tensor)
 	{
@@ -1,6 +1,7 @@
 #ifndef CUNDER_H_
 #define CUNDER_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -54,12 +55,71 @@ extern "C"
 		Cunder_Int64,
 		Cunder_Float32,
 		Cunder_Float64,
+		Cunder_Float16,
+		Cunder_BFloat16,
 		Cunder_Invalid
 	} Cunder_DType;
 
+	typedef enum
+	{
+		Cunder_ChannelsFirst, // NCHW
+		Cunder_ChannelsLast   // NHWC
+	} Cunder_ImageLayout;
+
+	// Post-processing operators
+	typedef enum
+	{
+		Cunder_Abs,
+		Cunder_Neg,
+		Cunder_Exp,
+		Cunder_Log,
+		Cunder_Sqrt,
+		Cunder_Sigmoid,
+		Cunder_Tanh,
+		Cunder_Relu
+	} Cunder_UnaryOp;
+
+	typedef enum
+	{
+		Cunder_Add,
+		Cunder_Sub,
+		Cunder_Mul,
+		Cunder_Div,
+		Cunder_Maximum,
+		Cunder_Minimum
+	} Cunder_BinaryOp;
+
+	typedef enum
+	{
+		Cunder_Sum,
+		Cunder_Mean,
+		Cunder_Max,
+		Cunder_Min
+	} Cunder_ReduceOp;
+
+	typedef enum
+	{
+		Cunder_Equal,
+		Cunder_NotEqual,
+		Cunder_Greater,
+		Cunder_GreaterEqual,
+		Cunder_Less,
+		Cunder_LessEqual
+	} Cunder_CompareOp;
+
 	typedef struct Cunder_Tensor Cunder_Tensor;
 	typedef struct Cunder_Module Cunder_Module;
 	typedef struct Cunder_Allocator Cunder_Allocator;
+	typedef struct Cunder_ModulePool Cunder_ModulePool;
+	typedef struct Cunder_Future Cunder_Future;
+	typedef struct Cunder_OutputBindings Cunder_OutputBindings;
+	typedef struct Cunder_Profiler Cunder_Profiler;
+	typedef struct Cunder_Session Cunder_Session;
+	typedef struct Cunder_ResultCache Cunder_ResultCache;
+	typedef struct Cunder_ModelRegistry Cunder_ModelRegistry;
+	typedef struct Cunder_TensorFile Cunder_TensorFile;
+	typedef struct Cunder_Pipeline Cunder_Pipeline;
+	typedef struct Cunder_Scheduler Cunder_Scheduler;
 
 	typedef struct
 	{
@@ -67,18 +127,206 @@ extern "C"
 		size_t length;
 	} Cunder_Array;
 
+	// Built-in caching CPU allocator configuration.
+	typedef struct
+	{
+		size_t max_cached_bytes;   // cap on the idle memory kept for reuse, 0 for no cap
+		bool per_thread_cache;     // small blocks (<= 32KB) are first cached per thread
+		size_t thread_cache_bytes; // cap of every per thread cache
+		bool use_hugepages;        // back large blocks with transparent huge pages (Linux)
+	} Cunder_CachingAllocatorConfig;
+
+#define CUNDER_ALLOCATOR_HISTOGRAM_BINS 32
+
+	// Allocator accounting, bytes are the sizes requested by LibTorch.
+	typedef struct
+	{
+		int64_t current_bytes;
+		int64_t peak_bytes;
+		int64_t allocations_count;
+		int64_t deallocations_count;
+		int64_t cached_bytes; // idle bytes kept by the caching allocator
+		// allocations count by size, bin i counts sizes in [2^i, 2^(i+1)), the last bin counts the larger ones
+		int64_t histogram[CUNDER_ALLOCATOR_HISTOGRAM_BINS];
+	} Cunder_AllocatorStats;
+
+	// Memory used between cunder_allocator_scope_begin() and cunder_allocator_scope_end().
+	typedef struct
+	{
+		int64_t start_bytes;
+		int64_t start_allocations_count;
+		int64_t peak_bytes; // high water mark above start_bytes
+		int64_t end_bytes;
+		int64_t allocations_count;
+	} Cunder_MemoryScope;
+
+	// Per operator profile, aggregated over every call in the profiled window.
+	typedef struct
+	{
+		const char *name; // owned by the profiler
+		int64_t calls_count;
+		double cpu_time_us;      // including the nested operators
+		double self_cpu_time_us; // excluding the nested operators
+		int64_t cpu_memory_bytes; // allocated by the operator itself
+	} Cunder_ProfilerOp;
+
+	// Inference options applied around every cunder_session_forward(), restored after it.
+	// The thread count and the TorchScript executor are process settings, see cunder_set_num_threads() and
+	// cunder_set_jit_profiling_executor().
+	typedef struct
+	{
+		bool inference_mode; // c10::InferenceMode, no autograd bookkeeping nor version counters
+		bool grad_enabled;   // autograd mode when inference_mode is off
+		bool jit_optimize;   // TorchScript graph executor optimizations
+	} Cunder_SessionOptions;
+
+	// Releases the memory wrapped by cunder_tensor_from_data_strided(), called once no tensor uses it.
+	typedef void (*Cunder_DataDeleter)(void *data, void *context);
+
+	typedef struct
+	{
+		int64_t hits;
+		int64_t misses;
+		int64_t evictions;
+		int64_t entries_count;
+		int64_t bytes; // cached inputs and outputs
+	} Cunder_ResultCacheStats;
+
+	typedef struct
+	{
+		int64_t models_count; // registered
+		int64_t resident_count;
+		int64_t resident_bytes; // parameters and buffers of the loaded modules
+		int64_t loads_count;
+		int64_t evictions_count;
+	} Cunder_ModelRegistryStats;
+
+	// Deadline aware batching scheduler configuration.
+	typedef struct
+	{
+		double target_p99_ms;  // request latency objective, submission to completion
+		size_t max_batch_size; // requests per forward
+		double max_window_ms;  // upper bound of the adaptive batching window
+		size_t queue_capacity; // pending requests, submissions past it are rejected (0 for no limit)
+		bool drop_expired;     // complete the requests past their deadline with an empty array instead of running them
+	} Cunder_SchedulerConfig;
+
+	typedef struct
+	{
+		int64_t requests_count;
+		int64_t batches_count;
+		int64_t deadline_misses_count;
+		int64_t dropped_count;
+		int64_t rejected_count;
+		int64_t pending_count;
+		double batch_size_ewma;
+		double forward_ewma_ms; // per batch
+		double p99_latency_ms;  // over the last 1024 requests
+		double window_ms;       // current batching window
+	} Cunder_SchedulerStats;
+
+	// Dynamic quantization summary, errors are measured on the calibration batch against the float module.
+	typedef struct
+	{
+		int64_t quantized_layers_count;
+		int64_t compared_elements_count; // floating point output elements compared, 0 without calibration batch
+		double max_abs_error;
+		double mean_abs_error;
+		double relative_error; // ||quantized - float|| / ||float||
+	} Cunder_QuantizationReport;
+
+	// Receives the forward outputs (owned by the callee, free with cunder_array_free), empty array on failure.
+	typedef void (*Cunder_ForwardCallback)(Cunder_Array outputs, void *user_data);
+
+	// Pipeline stages, called from the stage threads. The preprocess builds the module inputs of `request` in
+	// `out_inputs` (cunder_tensor_allocate, owned by the pipeline) and returns 0 on success. The postprocess
+	// receives the outputs (owned by the callee), an empty array if the request failed.
+	typedef int (*Cunder_PreprocessCallback)(void *request, Cunder_Array *out_inputs, void *user_data);
+	typedef void (*Cunder_PostprocessCallback)(void *request, Cunder_Array outputs, void *user_data);
+
+	// Called once the future completes, from the completing thread.
+	typedef void (*Cunder_FutureCallback)(Cunder_Future *future, void *user_data);
+
 	// API
 
 	// cunder allocator
+	// Tensors allocated through it cannot be released by raw_deleter(), at::Allocator::raw_allocate() is unsupported.
+	// Tensors may outlive cunder_allocator_free() (module parameters, LibTorch caches): the allocator is destroyed
+	// once the last of them is released, and `deallocate` must stay callable until then.
 	CUNDER_EXPORT Cunder_Allocator *
 	cunder_set_cpu_allocator(void *(*allocate)(size_t, uint8_t), void (*deallocate)(void *));
 
+	// Built-in caching allocator, a NULL `config` uses cunder_caching_allocator_default_config().
+	// Like the callback allocator it stays alive until cunder_allocator_free() and the release of its last tensor.
+	CUNDER_EXPORT Cunder_CachingAllocatorConfig
+	cunder_caching_allocator_default_config();
+
+	CUNDER_EXPORT Cunder_Allocator *
+	cunder_set_caching_cpu_allocator(const Cunder_CachingAllocatorConfig *config);
+
+	// Release the idle cached blocks back to the system (caching allocator only). The per thread caches of the other
+	// threads are only returned when those threads exit, they keep the caching allocator alive until then.
+	CUNDER_EXPORT void
+	cunder_allocator_empty_cache(Cunder_Allocator *allocator);
+
+	CUNDER_EXPORT int
+	cunder_allocator_stats(const Cunder_Allocator *allocator, Cunder_AllocatorStats *out_stats);
+
+	CUNDER_EXPORT void
+	cunder_allocator_reset_peak(Cunder_Allocator *allocator);
+
+	// Measure the allocations around a forward, e.g. begin, cunder_module_forward(), end.
+	// The allocator counts every thread and measures one scope at a time: begin returns -1 while another scope
+	// (nested or on another thread) is open, end returns -1 for a scope that was not begun. Returns 0 on success.
+	CUNDER_EXPORT int
+	cunder_allocator_scope_begin(Cunder_Allocator *allocator, Cunder_MemoryScope *scope);
+	CUNDER_EXPORT int
+	cunder_allocator_scope_end(Cunder_Allocator *allocator, Cunder_MemoryScope *scope);
+
+	// Restores the CPU allocator it replaced if `allocator` is the current one, allocators may be freed in any order.
 	CUNDER_EXPORT void
 	cunder_allocator_free(Cunder_Allocator *allocator);
 
 	CUNDER_EXPORT Torch_Version
 	cunder_torch_version();
 
+	// LibTorch thread pools, shared by every module of the process. Returns 0 on success.
+	CUNDER_EXPORT int
+	cunder_set_num_threads(int threads_count);
+	CUNDER_EXPORT int
+	cunder_get_num_threads();
+
+	// Can only be set once, before the first inter-op task runs.
+	CUNDER_EXPORT int
+	cunder_set_num_interop_threads(int threads_count);
+	CUNDER_EXPORT int
+	cunder_get_num_interop_threads();
+
+	// TorchScript profiling executor (the default) or the legacy executor, process wide.
+	// Set it once before the first forward, modules already run keep their compiled plans.
+	CUNDER_EXPORT int
+	cunder_set_jit_profiling_executor(bool enabled);
+	CUNDER_EXPORT bool
+	cunder_get_jit_profiling_executor();
+
+	// Pin the calling thread to `cpus` (Linux, Windows up to 64 cpus).
+	CUNDER_EXPORT int
+	cunder_set_thread_affinity(const int *cpus, size_t cpus_count);
+
+	// Write up to `capacity` cpus the calling thread may run on into `out_cpus`, returns their count or -1.
+	CUNDER_EXPORT int
+	cunder_get_thread_affinity(int *out_cpus, size_t capacity);
+
+	// Pin the intra-op threads used by the calling thread to `cpus`, best effort. The calling thread runs its
+	// share of the parallel regions and is pinned too, save its cpus with cunder_get_thread_affinity() first to
+	// restore them. Call it again after cunder_set_num_threads().
+	CUNDER_EXPORT int
+	cunder_set_intra_op_affinity(const int *cpus, size_t cpus_count);
+
+	// Write up to `capacity` cpus of NUMA `node` into `out_cpus`, returns the node cpus count or -1.
+	CUNDER_EXPORT int
+	cunder_numa_node_cpus(int node, int *out_cpus, size_t capacity);
+
 	CUNDER_EXPORT Cunder_Array
 	cunder_tensor_allocate(size_t tensors_count);
 
@@ -119,6 +367,50 @@ extern "C"
 	CUNDER_EXPORT Cunder_Tensor *
 	cunder_tensor_from_data(int ndim, const int *shape, void *data, Cunder_DType dtype);
 
+	// Wrap `data` without copying, `strides` are in elements (NULL for contiguous). A non NULL `deleter` takes
+	// the ownership of `data`, it is called with `context` once the last tensor using the memory is released.
+	// On failure NULL is returned and the caller keeps the ownership.
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_from_data_strided(
+		int ndim, const int64_t *shape, const int64_t *strides, void *data, Cunder_DType dtype, Cunder_DataDeleter deleter, void *context);
+
+	// Uninitialized tensor, e.g. the destination of cunder_tensor_convert_from()
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_empty(int ndim, const int *shape, Cunder_DType dtype);
+
+	// Convert the contiguous `data` of `dtype` (numel of `destination` elements) into the preallocated
+	// `destination`, e.g. float32 or uint8 features into a float16/bfloat16 model input. No allocation.
+	CUNDER_EXPORT int
+	cunder_tensor_convert_from(Cunder_Tensor *destination, const void *data, Cunder_DType dtype);
+
+	// Image preprocessing, u8 HWC pixels (`row_stride` bytes between rows, 0 for packed rows) to normalized floats:
+	// out = (pixel - mean[c]) / stddev[c], mean and stddev in pixel units (x255 the torchvision values), NULL for 0 and 1.
+	// The conversion, normalization and layout change run in a single pass over the image.
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_from_image_u8(
+		const uint8_t *data,
+		int height,
+		int width,
+		int channels,
+		size_t row_stride,
+		const float *mean,
+		const float *stddev,
+		Cunder_ImageLayout layout);
+
+	// Same, written into image `batch_index` of a preallocated float32 NCHW or NHWC `destination`.
+	CUNDER_EXPORT int
+	cunder_tensor_image_u8_into(
+		Cunder_Tensor *destination,
+		int64_t batch_index,
+		const uint8_t *data,
+		int height,
+		int width,
+		int channels,
+		size_t row_stride,
+		const float *mean,
+		const float *stddev,
+		Cunder_ImageLayout layout);
+
 	// Tensor to()
 
 	CUNDER_EXPORT void
@@ -139,6 +431,11 @@ extern "C"
 	cunder_tensor_shape(const Cunder_Tensor *tensor, int64_t *out_shape);
 	CUNDER_EXPORT int64_t
 	cunder_tensor_numel(const Cunder_Tensor *tensor);
+	// Strides in elements.
+	CUNDER_EXPORT void
+	cunder_tensor_strides(const Cunder_Tensor *tensor, int64_t *out_strides);
+	CUNDER_EXPORT bool
+	cunder_tensor_is_contiguous(const Cunder_Tensor *tensor);
 	CUNDER_EXPORT int64_t
 	cunder_tensor_dim_size(const Cunder_Tensor *tensor, int64_t dim);
 
@@ -160,14 +457,126 @@ extern "C"
 	cunder_tensor_accessor_f32(const Cunder_Tensor *tensor);
 	CUNDER_EXPORT const double *
 	cunder_tensor_accessor_f64(const Cunder_Tensor *tensor);
+	// float16 and bfloat16 raw bits
+	CUNDER_EXPORT const uint16_t *
+	cunder_tensor_accessor_f16(const Cunder_Tensor *tensor);
+	CUNDER_EXPORT const uint16_t *
+	cunder_tensor_accessor_bf16(const Cunder_Tensor *tensor);
 
-	// torch jit module load
+	// Tensor post-processing, run by the LibTorch kernels, return new tensors (NULL on failure)
+
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_unary(const Cunder_Tensor *tensor, Cunder_UnaryOp op);
+
+	// Elementwise with broadcasting.
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_binary(const Cunder_Tensor *a, const Cunder_Tensor *b, Cunder_BinaryOp op);
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_binary_scalar(const Cunder_Tensor *a, double b, Cunder_BinaryOp op);
+
+	// Reduce over `dims` (every dim if `dims_count` is 0).
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_reduce(const Cunder_Tensor *tensor, Cunder_ReduceOp op, const int64_t *dims, size_t dims_count, bool keepdim);
+
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_softmax(const Cunder_Tensor *tensor, int64_t dim);
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_log_softmax(const Cunder_Tensor *tensor, int64_t dim);
+
+	// int64 indices
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_argmax(const Cunder_Tensor *tensor, int64_t dim, bool keepdim);
+
+	// The `k` largest (or smallest) elements along `dim`, values and int64 indices. Returns 0 on success.
+	CUNDER_EXPORT int
+	cunder_tensor_topk(
+		const Cunder_Tensor *tensor, int64_t k, int64_t dim, bool largest, Cunder_Tensor **out_values, Cunder_Tensor **out_indices);
+
+	// Bool masks
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_compare(const Cunder_Tensor *a, const Cunder_Tensor *b, Cunder_CompareOp op);
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_compare_scalar(const Cunder_Tensor *a, double b, Cunder_CompareOp op);
+
+	// Tensor export
+
+	// Zero-copy access, the tensor data if it is contiguous and of `dtype`, NULL otherwise.
+	CUNDER_EXPORT const void *
+	cunder_tensor_data_view(const Cunder_Tensor *tensor, Cunder_DType dtype);
+
+	// Write any tensor (non contiguous, any dtype) into `data` (`nbytes` capacity) as `dtype`, `strides` are the
+	// destination strides in elements (NULL for contiguous). A single pass, nothing is copied if the tensor
+	// already lives in `data` with that layout. Returns -1 on failure or if `data` is too small.
+	CUNDER_EXPORT int
+	cunder_tensor_export(const Cunder_Tensor *tensor, void *data, size_t nbytes, Cunder_DType dtype, const int64_t *strides);
+
+	// Tensor files, named tensors stored as raw data (64 bytes aligned) with an index, in native byte order.
+
+	// `names[i]` names `tensors.data[i]`. Returns 0 on success.
+	CUNDER_EXPORT int
+	cunder_tensor_file_save(const char *filename, const char *const *names, Cunder_Array tensors);
+
+	// Memory map a tensor file (copy on write), only the index is read.
+	CUNDER_EXPORT Cunder_TensorFile *
+	cunder_tensor_file_open(const char *filename);
+
+	// The tensors already taken stay valid, they keep the mapping alive.
+	CUNDER_EXPORT int
+	cunder_tensor_file_close(Cunder_TensorFile *file);
+
+	// 0 for a NULL file.
+	CUNDER_EXPORT size_t
+	cunder_tensor_file_count(const Cunder_TensorFile *file);
+	CUNDER_EXPORT const char *
+	cunder_tensor_file_name(const Cunder_TensorFile *file, size_t i);
+
+	// Zero-copy views over the mapped data, NULL if not found. Writes stay private to the process.
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_file_get(const Cunder_TensorFile *file, const char *name);
+	CUNDER_EXPORT Cunder_Tensor *
+	cunder_tensor_file_get_at(const Cunder_TensorFile *file, size_t i);
+
+	// torch jit module load, on failure NULL is returned and cunder_module_last_error() tells why
 	CUNDER_EXPORT Cunder_Module *
 	cunder_module_load(const char *filename);
 
+	// Message of the last failed module load on the calling thread, empty after a successful one.
+	// Valid until the next load on that thread.
+	CUNDER_EXPORT const char *
+	cunder_module_last_error();
+
+	// Load from a TorchScript archive in memory, `data` is only read during the call.
+	CUNDER_EXPORT Cunder_Module *
+	cunder_module_load_buffer(const void *data, size_t size);
+
+	// Load from a memory mapped TorchScript archive (POSIX, Windows), the mapping is released once loaded.
+	CUNDER_EXPORT Cunder_Module *
+	cunder_module_load_mmap(const char *filename);
+
 	CUNDER_EXPORT void
 	cunder_module_eval(Cunder_Module *cunder_module);
 
+	// Freeze a copy of the module (weights become constants, conv-bn folding, dropout removal).
+	// `optimize_for_inference` also runs the TorchScript inference passes (op fusion, MKLDNN conversion).
+	CUNDER_EXPORT Cunder_Module *
+	cunder_module_freeze(const Cunder_Module *cunder_module, bool optimize_for_inference);
+
+	// Execution replica of the module (own module objects, methods and executors) sharing the parameters and
+	// buffers storage of `cunder_module`, e.g. one per thread without duplicating the weights. The shared
+	// tensors must be treated as read only, either module can be freed first.
+	CUNDER_EXPORT Cunder_Module *
+	cunder_module_replicate(const Cunder_Module *cunder_module);
+
+	// `replicas_count` replicas written to `out_replicas`, none is created on failure.
+	CUNDER_EXPORT int
+	cunder_module_replicate_n(const Cunder_Module *cunder_module, size_t replicas_count, Cunder_Module **out_replicas);
+
+	// Dynamically quantized copy of the module: the Linear weights are quantized to int8 (per output channel)
+	// ahead of time and the activations per batch. `calibration_inputs` (optional) is one forward input used
+	// to fill the report errors. LSTM and other recurrent layers are left in float.
+	CUNDER_EXPORT Cunder_Module *
+	cunder_module_quantize_dynamic(const Cunder_Module *cunder_module, const Cunder_Array *calibration_inputs, Cunder_QuantizationReport *out_report);
+
 	CUNDER_EXPORT void
 	cunder_module_dump(const Cunder_Module *module, bool print_method_bodies, bool print_attr_values, bool print_param_values);
 
@@ -178,6 +587,227 @@ extern "C"
 	CUNDER_EXPORT Cunder_Array
 	cunder_module_forward(Cunder_Module *cunder_module, Cunder_Array tensors_array);
 
+	// Inference session, a NULL `options` uses cunder_session_default_options() (inference mode, no grad).
+	CUNDER_EXPORT Cunder_SessionOptions
+	cunder_session_default_options();
+
+	CUNDER_EXPORT Cunder_Session *
+	cunder_session_create(const Cunder_SessionOptions *options);
+
+	CUNDER_EXPORT int
+	cunder_session_free(Cunder_Session *session);
+
+	// Forward with the session options, empty array on failure.
+	// Outputs of an inference mode forward can't be used in autograd later.
+	CUNDER_EXPORT Cunder_Array
+	cunder_session_forward(const Cunder_Session *session, Cunder_Module *cunder_module, Cunder_Array tensors_array);
+
+	// Concatenate `requests_count` requests along dim 0, run a single forward and split the outputs back
+	// into `out_responses` (views into the batched outputs). Every output is split like the inputs having its
+	// batch size, -1 is returned when no input matches or when matching inputs split differently.
+	CUNDER_EXPORT int
+	cunder_module_forward_batch(Cunder_Module *cunder_module, const Cunder_Array *requests, size_t requests_count, Cunder_Array *out_responses);
+
+	// Output bindings, caller buffers the module outputs are written into.
+	CUNDER_EXPORT Cunder_OutputBindings *
+	cunder_output_bindings_create(size_t outputs_count);
+
+	CUNDER_EXPORT int
+	cunder_output_bindings_free(Cunder_OutputBindings *bindings);
+
+	// Bind `data` (`nbytes` capacity) to output `index`, the output is converted to `dtype`. NULL `data` unbinds.
+	CUNDER_EXPORT int
+	cunder_output_bindings_set(Cunder_OutputBindings *bindings, size_t index, void *data, size_t nbytes, Cunder_DType dtype);
+
+	// Shape of the last output written to `index`, -1 ndim if nothing was written.
+	CUNDER_EXPORT int64_t
+	cunder_output_bindings_ndim(const Cunder_OutputBindings *bindings, size_t index);
+	CUNDER_EXPORT void
+	cunder_output_bindings_shape(const Cunder_OutputBindings *bindings, size_t index, int64_t *out_shape);
+
+	// Forward and write the outputs into the bound buffers (unbound outputs are dropped).
+	// Returns -1 on failure or if an output does not fit its buffer (or is complex for a real buffer), in which
+	// case no buffer is written.
+	CUNDER_EXPORT int
+	cunder_module_forward_into(Cunder_Module *cunder_module, Cunder_Array tensors_array, Cunder_OutputBindings *bindings);
+
+	// Result cache in front of a module, keyed by a hash of the inputs dtype, shape and bytes (checked on hits).
+	// Least recently used results are evicted past `max_bytes`. `cunder_module` must outlive the cache.
+	CUNDER_EXPORT Cunder_ResultCache *
+	cunder_result_cache_create(Cunder_Module *cunder_module, size_t max_bytes);
+
+	CUNDER_EXPORT int
+	cunder_result_cache_free(Cunder_ResultCache *cache);
+
+	// Cached outputs or a forward on a miss. Outputs share the cached storage, treat them as read only.
+	CUNDER_EXPORT Cunder_Array
+	cunder_result_cache_forward(Cunder_ResultCache *cache, Cunder_Array tensors_array);
+
+	CUNDER_EXPORT int
+	cunder_result_cache_stats(Cunder_ResultCache *cache, Cunder_ResultCacheStats *out_stats);
+
+	CUNDER_EXPORT void
+	cunder_result_cache_clear(Cunder_ResultCache *cache);
+
+	// Model registry, modules keyed by name and version, loaded (in eval mode) on first acquire. Past
+	// `memory_budget_bytes` (0 for no budget) the least recently used unreferenced modules are unloaded.
+	CUNDER_EXPORT Cunder_ModelRegistry *
+	cunder_model_registry_create(size_t memory_budget_bytes);
+
+	CUNDER_EXPORT int
+	cunder_model_registry_free(Cunder_ModelRegistry *registry);
+
+	// Only records the file, nothing is loaded.
+	CUNDER_EXPORT int
+	cunder_model_registry_register(Cunder_ModelRegistry *registry, const char *name, int64_t version, const char *filename);
+
+	// Fails while the model is acquired. A negative `version` picks the latest one here and below.
+	CUNDER_EXPORT int
+	cunder_model_registry_unregister(Cunder_ModelRegistry *registry, const char *name, int64_t version);
+
+	// The module stays owned by the registry and resident until released, NULL if unknown or failed to load.
+	CUNDER_EXPORT Cunder_Module *
+	cunder_model_registry_acquire(Cunder_ModelRegistry *registry, const char *name, int64_t version);
+
+	CUNDER_EXPORT int
+	cunder_model_registry_release(Cunder_ModelRegistry *registry, Cunder_Module *cunder_module);
+
+	// Parameters and buffers bytes of a loaded model, -1 if not resident.
+	CUNDER_EXPORT int64_t
+	cunder_model_registry_footprint(Cunder_ModelRegistry *registry, const char *name, int64_t version);
+
+	CUNDER_EXPORT int
+	cunder_model_registry_stats(Cunder_ModelRegistry *registry, Cunder_ModelRegistryStats *out_stats);
+
+	// torch jit module pool, worker threads sharing a single module.
+	// `cunder_module` must outlive the pool, 0 workers uses the hardware concurrency.
+	CUNDER_EXPORT Cunder_ModulePool *
+	cunder_module_pool_create(Cunder_Module *cunder_module, size_t workers_count, size_t queue_capacity);
+
+	// Runs the pending requests then joins the workers.
+	CUNDER_EXPORT int
+	cunder_module_pool_free(Cunder_ModulePool *pool);
+
+	// 0 for a NULL pool.
+	CUNDER_EXPORT size_t
+	cunder_module_pool_workers_count(const Cunder_ModulePool *pool);
+
+	// Pin every worker of the pool to `cpus`.
+	CUNDER_EXPORT int
+	cunder_module_pool_set_affinity(Cunder_ModulePool *pool, const int *cpus, size_t cpus_count);
+
+	// Queue a forward, `callback` is called from a worker thread. Blocks while the queue is full,
+	// a callback submitting to its own pool may then wait forever: prefer cunder_module_pool_forward_async() there.
+	CUNDER_EXPORT int
+	cunder_module_pool_submit(Cunder_ModulePool *pool, Cunder_Array tensors_array, Cunder_ForwardCallback callback, void *user_data);
+
+	// Queue a forward and wait for its outputs. Called from a worker of `pool` (e.g. in a forward callback)
+	// it would wait for itself and returns an empty array instead.
+	CUNDER_EXPORT Cunder_Array
+	cunder_module_pool_forward(Cunder_ModulePool *pool, Cunder_Array tensors_array);
+
+	// Queue a forward and return immediately, nullptr if the pool is closed.
+	CUNDER_EXPORT Cunder_Future *
+	cunder_module_pool_forward_async(Cunder_ModulePool *pool, Cunder_Array tensors_array);
+
+	// Pipeline, preprocess, forward and postprocess run concurrently on three threads connected by bounded
+	// queues of `queue_capacity` (0 for 64). Requests complete in submission order.
+	CUNDER_EXPORT Cunder_Pipeline *
+	cunder_pipeline_create(
+		Cunder_Module *cunder_module,
+		Cunder_PreprocessCallback preprocess,
+		Cunder_PostprocessCallback postprocess,
+		void *user_data,
+		size_t queue_capacity);
+
+	// Processes the submitted requests then joins the stages.
+	CUNDER_EXPORT int
+	cunder_pipeline_free(Cunder_Pipeline *pipeline);
+
+	// Blocks while the first queue is full (backpressure).
+	CUNDER_EXPORT int
+	cunder_pipeline_submit(Cunder_Pipeline *pipeline, void *request);
+
+	// Returns 1 instead of blocking if the first queue is full.
+	CUNDER_EXPORT int
+	cunder_pipeline_try_submit(Cunder_Pipeline *pipeline, void *request);
+
+	// Wait until every request submitted before the call was postprocessed.
+	CUNDER_EXPORT int
+	cunder_pipeline_flush(Cunder_Pipeline *pipeline);
+
+	// Deadline aware scheduler, requests are batched along dim 0 (see cunder_module_forward_batch) and dispatched
+	// by priority then earliest deadline. The batching window grows while the observed p99 stays under the
+	// target and the queue is shallow, it shrinks when the p99 overshoots or a full batch is already queued.
+	// A batch also leaves early when any pending request would otherwise miss its deadline given the predicted
+	// forward time. `cunder_module` must outlive the scheduler.
+	CUNDER_EXPORT Cunder_SchedulerConfig
+	cunder_scheduler_default_config();
+
+	CUNDER_EXPORT Cunder_Scheduler *
+	cunder_scheduler_create(Cunder_Module *cunder_module, const Cunder_SchedulerConfig *config);
+
+	// Dispatches the pending requests then joins the dispatcher.
+	CUNDER_EXPORT int
+	cunder_scheduler_free(Cunder_Scheduler *scheduler);
+
+	// `deadline_ms` is relative to now (<= 0 for the target p99), higher `priority` first.
+	// NULL if the queue is full.
+	CUNDER_EXPORT Cunder_Future *
+	cunder_scheduler_submit(Cunder_Scheduler *scheduler, Cunder_Array tensors_array, double deadline_ms, int priority);
+
+	CUNDER_EXPORT int
+	cunder_scheduler_stats(Cunder_Scheduler *scheduler, Cunder_SchedulerStats *out_stats);
+
+	// cunder future
+	CUNDER_EXPORT bool
+	cunder_future_poll(const Cunder_Future *future);
+
+	// Returns 0 when completed, 1 on timeout. A negative `timeout_ms` waits forever.
+	CUNDER_EXPORT int
+	cunder_future_wait(Cunder_Future *future, int64_t timeout_ms);
+
+	// Wait and take the outputs (owned by the caller), empty array on failure or if already taken.
+	CUNDER_EXPORT Cunder_Array
+	cunder_future_get(Cunder_Future *future);
+
+	// Called right away if the future already completed. cunder_future_free() waits for a running callback,
+	// the callback itself may free the future.
+	CUNDER_EXPORT int
+	cunder_future_set_callback(Cunder_Future *future, Cunder_FutureCallback callback, void *user_data);
+
+	// Linux eventfd (non blocking) readable once the future completes, owned by the future. -1 if unsupported.
+	CUNDER_EXPORT int
+	cunder_future_eventfd(Cunder_Future *future);
+
+	CUNDER_EXPORT int
+	cunder_future_free(Cunder_Future *future);
+
+	// LibTorch operator profiler, records the operators run by the calling thread (and its intra-op threads)
+	// between start and stop. A single profiler can run at a time.
+	CUNDER_EXPORT Cunder_Profiler *
+	cunder_profiler_start(bool record_shapes, bool profile_memory);
+
+	CUNDER_EXPORT int
+	cunder_profiler_stop(Cunder_Profiler *profiler);
+
+	CUNDER_EXPORT int
+	cunder_profiler_free(Cunder_Profiler *profiler);
+
+	// Operators sorted by self cpu time, available once stopped.
+	CUNDER_EXPORT size_t
+	cunder_profiler_ops_count(const Cunder_Profiler *profiler);
+	CUNDER_EXPORT int
+	cunder_profiler_op(const Cunder_Profiler *profiler, size_t i, Cunder_ProfilerOp *out_op);
+
+	// Chrome trace JSON (chrome://tracing, Perfetto).
+	CUNDER_EXPORT int
+	cunder_profiler_export_chrome_trace(const Cunder_Profiler *profiler, const char *filename);
+
+	// Sorted text table, a NULL `filename` prints to stdout.
+	CUNDER_EXPORT int
+	cunder_profiler_write_summary(const Cunder_Profiler *profiler, const char *filename);
+
 	CUNDER_EXPORT void
 	cunder_tensor_print_attributes(Cunder_Tensor *tensor);
 
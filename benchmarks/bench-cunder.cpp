@@ -0,0 +1,221 @@
+#include "c_libtorch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Latency of a single benchmarked path, in nanoseconds.
+struct Bench_Result
+{
+	std::string name;
+	size_t iterations;
+	double mean_ns;
+	double min_ns;
+	double p50_ns;
+	double p99_ns;
+	double p999_ns;
+	double max_ns;
+};
+
+static double
+percentile(const std::vector<double> &sorted_samples, double p)
+{
+	size_t index = (size_t)(p * (double)(sorted_samples.size() - 1) + 0.5);
+	return sorted_samples[std::min(index, sorted_samples.size() - 1)];
+}
+
+// Run `warmup` untimed iterations then time every one of the `iterations` iterations.
+static Bench_Result
+run_bench(const std::string &name, size_t warmup, size_t iterations, const std::function<void()> &body)
+{
+	for (size_t i = 0; i < warmup; ++i)
+		body();
+
+	std::vector<double> samples(iterations);
+	for (size_t i = 0; i < iterations; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+		body();
+		auto end = std::chrono::steady_clock::now();
+		samples[i] = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	}
+
+	std::sort(samples.begin(), samples.end());
+	double total = 0;
+	for (double sample : samples)
+		total += sample;
+
+	Bench_Result result;
+	result.name = name;
+	result.iterations = iterations;
+	result.mean_ns = total / (double)iterations;
+	result.min_ns = samples.front();
+	result.p50_ns = percentile(samples, 0.50);
+	result.p99_ns = percentile(samples, 0.99);
+	result.p999_ns = percentile(samples, 0.999);
+	result.max_ns = samples.back();
+	printf(
+		"%-48s p50 %12.0f ns  p99 %12.0f ns  p999 %12.0f ns\n", result.name.c_str(), result.p50_ns, result.p99_ns, result.p999_ns);
+	return result;
+}
+
+static bool
+write_json(const char *filename, const std::vector<Bench_Result> &results)
+{
+	FILE *out = fopen(filename, "w");
+	if (out == NULL)
+		return false;
+
+	Torch_Version version = cunder_torch_version();
+	fprintf(out, "{\n  \"torch_version\": \"%d.%d.%d\",\n  \"unit\": \"ns\",\n  \"benchmarks\": [\n", version.major, version.minor, version.patch);
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const Bench_Result &result = results[i];
+		fprintf(
+			out,
+			"    {\"name\": \"%s\", \"iterations\": %zu, \"mean\": %.1f, \"min\": %.1f, \"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, "
+			"\"max\": %.1f}%s\n",
+			result.name.c_str(),
+			result.iterations,
+			result.mean_ns,
+			result.min_ns,
+			result.p50_ns,
+			result.p99_ns,
+			result.p999_ns,
+			result.max_ns,
+			i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+	fclose(out);
+	return true;
+}
+
+static void
+bench_tensors(std::vector<Bench_Result> &results)
+{
+	const size_t warmup = 1000;
+	const size_t iterations = 100000;
+
+	int small_shape[] = {1, 16};
+	int large_shape[] = {3, 224, 224};
+	results.push_back(run_bench("tensor_zeros/1x16", warmup, iterations, [&] {
+		cunder_tensor_free(cunder_tensor_zeros(2, small_shape, Cunder_Float32));
+	}));
+	results.push_back(run_bench("tensor_zeros/3x224x224", warmup, iterations / 10, [&] {
+		cunder_tensor_free(cunder_tensor_zeros(3, large_shape, Cunder_Float32));
+	}));
+
+	std::vector<float> data(3 * 224 * 224, 1.0f);
+	results.push_back(run_bench("tensor_from_data/1x16", warmup, iterations, [&] {
+		cunder_tensor_free(cunder_tensor_from_data(2, small_shape, data.data(), Cunder_Float32));
+	}));
+	results.push_back(run_bench("tensor_from_data/3x224x224", warmup, iterations / 10, [&] {
+		cunder_tensor_free(cunder_tensor_from_data(3, large_shape, data.data(), Cunder_Float32));
+	}));
+
+	Cunder_Tensor *small_tensor = cunder_tensor_from_data(2, small_shape, data.data(), Cunder_Float32);
+	Cunder_Tensor *large_tensor = cunder_tensor_from_data(3, large_shape, data.data(), Cunder_Float32);
+	results.push_back(run_bench("tensor_clone/1x16", warmup, iterations, [&] { cunder_tensor_free(cunder_tensor_clone(small_tensor)); }));
+	results.push_back(run_bench("tensor_clone/3x224x224", warmup, iterations / 10, [&] {
+		cunder_tensor_free(cunder_tensor_clone(large_tensor));
+	}));
+
+	// accessor overhead: the binding calls needed to read a tensor
+	volatile float sink = 0;
+	results.push_back(run_bench("tensor_accessor/f32", warmup, iterations, [&] {
+		const float *values = cunder_tensor_accessor_f32(small_tensor);
+		sink = values[cunder_tensor_numel(small_tensor) - 1];
+	}));
+	int64_t shape[3];
+	results.push_back(run_bench("tensor_accessor/shape", warmup, iterations, [&] {
+		cunder_tensor_shape(large_tensor, shape);
+		sink = (float)(shape[0] + cunder_tensor_ndim(large_tensor));
+	}));
+	(void)sink;
+
+	cunder_tensor_free(small_tensor);
+	cunder_tensor_free(large_tensor);
+}
+
+// False if a model failed to load, the other benchmarks still run.
+static bool
+bench_module_forward(std::vector<Bench_Result> &results)
+{
+	bool loaded = true;
+	const size_t warmup = 100;
+	const size_t iterations = 10000;
+	const int batch_sizes[] = {1, 8, 32, 128};
+
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model.pt");
+	if (cunder_module != NULL)
+	{
+		cunder_module_eval(cunder_module);
+		for (int batch_size : batch_sizes)
+		{
+			std::vector<float> data(batch_size * 2, 0.5f);
+			int shape[] = {/* batch */ batch_size, /* channel */ 2};
+			Cunder_Tensor *input = cunder_tensor_from_data(2, shape, data.data(), Cunder_Float32);
+			Cunder_Array module_input = {input, 1};
+			results.push_back(run_bench("module_forward/model/batch_" + std::to_string(batch_size), warmup, iterations, [&] {
+				cunder_array_free(cunder_module_forward(cunder_module, module_input));
+			}));
+			cunder_tensor_free(input);
+		}
+		cunder_module_free(cunder_module);
+	}
+	else
+	{
+		printf("failed to load %s: %s\n", CUNDER_DATA_DIR "/model.pt", cunder_module_last_error());
+		loaded = false;
+	}
+
+	Cunder_Module *cunder_module_2_3 = cunder_module_load(CUNDER_DATA_DIR "/model_2_input_3_output.pt");
+	if (cunder_module_2_3 != NULL)
+	{
+		cunder_module_eval(cunder_module_2_3);
+		for (int batch_size : batch_sizes)
+		{
+			std::vector<float> data(batch_size, 0.5f);
+			int shape[] = {/* batch */ batch_size, /* channel */ 1};
+			Cunder_Array module_inputs = cunder_tensor_allocate(2);
+			for (size_t i = 0; i < 2; ++i)
+			{
+				Cunder_Tensor *input = cunder_tensor_from_data(2, shape, data.data(), Cunder_Float32);
+				cunder_tensor_array_set(module_inputs, i, input);
+				cunder_tensor_free(input);
+			}
+			results.push_back(run_bench("module_forward/model_2_input_3_output/batch_" + std::to_string(batch_size), warmup, iterations, [&] {
+				cunder_array_free(cunder_module_forward(cunder_module_2_3, module_inputs));
+			}));
+			cunder_array_free(module_inputs);
+		}
+		cunder_module_free(cunder_module_2_3);
+	}
+	else
+	{
+		printf("failed to load %s: %s\n", CUNDER_DATA_DIR "/model_2_input_3_output.pt", cunder_module_last_error());
+		loaded = false;
+	}
+	return loaded;
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *output_filename = argc > 1 ? argv[1] : "cunder_bench.json";
+
+	std::vector<Bench_Result> results;
+	bench_tensors(results);
+	bool models_loaded = bench_module_forward(results);
+
+	if (write_json(output_filename, results) == false)
+	{
+		printf("failed to write %s\n", output_filename);
+		return 1;
+	}
+	printf("results written to %s\n", output_filename);
+	return models_loaded ? 0 : 1;
+}
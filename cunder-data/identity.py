@@ -0,0 +1,11 @@
+import torch
+
+
+class Identity(torch.nn.Module):
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        return x
+
+
+module = torch.jit.script(Identity())
+module.eval()
+module.save("identity.pt")
@@ -0,0 +1,17 @@
+import torch
+
+
+# 2 -> 4 features, fixed weights so the tests can rely on the outputs
+class Linear(torch.nn.Module):
+    def __init__(self):
+        super().__init__()
+        self.weight = torch.nn.Parameter(torch.tensor([[0.5, -0.25], [1.0, 0.75], [-0.5, 0.125], [0.25, -1.0]]))
+        self.bias = torch.nn.Parameter(torch.tensor([0.1, -0.2, 0.3, 0.0]))
+
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        return torch.nn.functional.linear(x, self.weight, self.bias)
+
+
+module = torch.jit.script(Linear())
+module.eval()
+module.save("linear.pt")
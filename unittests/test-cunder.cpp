@@ -1,6 +1,19 @@
 #include <doctest/doctest.h>
 #include "c_libtorch.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif // __linux__
+
 // Create zeros tensor
 TEST_CASE("[Tensor] zeros")
 {
@@ -136,4 +149,1567 @@ TEST_CASE("[Module] forward")
 	cunder_tensor_free(cunder_data_tensor_3);
 	cunder_array_free(output_tensors);
 	cunder_module_free(cunder_module);
-}
\ No newline at end of file
+}
+
+// {5, 1} and {4, 1} float inputs of model_2_input_3_output.pt, the array owns copies of the data
+static Cunder_Array
+model_2_input_3_output_inputs()
+{
+	float tensor_data_2[] = {1, 9, 0, 3, 2};
+	int tensor_data_shape_2[] = {/* batch */ 5, /* channel */ 1};
+	float tensor_data_3[] = {0, 3, 2, 1};
+	int tensor_data_shape_3[] = {/* batch */ 4, /* channel */ 1};
+	auto cunder_data_tensor_2 = cunder_tensor_from_data(2, tensor_data_shape_2, tensor_data_2, Cunder_DType::Cunder_Float32);
+	auto cunder_data_tensor_3 = cunder_tensor_from_data(2, tensor_data_shape_3, tensor_data_3, Cunder_DType::Cunder_Float32);
+	auto cunder_tensor_2 = cunder_tensor_clone(cunder_data_tensor_2);
+	auto cunder_tensor_3 = cunder_tensor_clone(cunder_data_tensor_3);
+
+	Cunder_Array model_inputs = cunder_tensor_allocate(2);
+	cunder_tensor_array_set(model_inputs, 0, cunder_tensor_2);
+	cunder_tensor_array_set(model_inputs, 1, cunder_tensor_3);
+	cunder_tensor_free(cunder_data_tensor_2);
+	cunder_tensor_free(cunder_data_tensor_3);
+	cunder_tensor_free(cunder_tensor_2);
+	cunder_tensor_free(cunder_tensor_3);
+	return model_inputs;
+}
+
+// cunder_module batched forward
+TEST_CASE("[Module] forward batch")
+{
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model_2_input_3_output.pt");
+	cunder_module_eval(cunder_module);
+
+	Cunder_Array requests[2];
+	for (Cunder_Array &request : requests)
+		request = model_2_input_3_output_inputs();
+
+	// every split output matches the unbatched forward of its request
+	Cunder_Array expected_outputs = cunder_module_forward(cunder_module, requests[0]);
+	REQUIRE(expected_outputs.length == 3);
+	Cunder_Array responses[2];
+	CHECK(cunder_module_forward_batch(cunder_module, requests, 2, responses) == 0);
+	for (Cunder_Array &response : responses)
+	{
+		REQUIRE(response.length == 3);
+		CHECK(cunder_tensor_numel(cunder_tensor_array_get(response, 0)) == 15);
+		CHECK(cunder_tensor_numel(cunder_tensor_array_get(response, 1)) == 12);
+		for (size_t o = 0; o < 3; ++o)
+		{
+			Cunder_Tensor *output = cunder_tensor_array_get(response, o);
+			Cunder_Tensor *expected = cunder_tensor_array_get(expected_outputs, o);
+			REQUIRE(cunder_tensor_numel(output) == cunder_tensor_numel(expected));
+			for (int64_t e = 0; e < cunder_tensor_numel(expected); ++e)
+				CHECK(cunder_tensor_accessor_f32(output)[e] == doctest::Approx(cunder_tensor_accessor_f32(expected)[e]));
+		}
+		cunder_array_free(response);
+	}
+	cunder_array_free(expected_outputs);
+
+	// same batch totals per input, split differently: {5, 4} rows then {4, 5} rows
+	std::swap(requests[1].data[0], requests[1].data[1]);
+	CHECK(cunder_module_forward_batch(cunder_module, requests, 2, responses) == -1);
+
+	for (Cunder_Array &request : requests)
+		cunder_array_free(request);
+	cunder_module_free(cunder_module);
+}
+
+// cunder_module pool forward
+TEST_CASE("[Module] pool")
+{
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model_2_input_3_output.pt");
+	cunder_module_eval(cunder_module);
+	Cunder_ModulePool *pool = cunder_module_pool_create(cunder_module, 2, 8);
+	CHECK(cunder_module_pool_workers_count(pool) == 2);
+
+	Cunder_Array model_inputs = model_2_input_3_output_inputs();
+
+	SUBCASE("forward")
+	{
+		Cunder_Array output_tensors = cunder_module_pool_forward(pool, model_inputs);
+		CHECK(output_tensors.length == 3);
+		CHECK(cunder_tensor_numel(cunder_tensor_array_get(output_tensors, 2)) == 30);
+		cunder_array_free(output_tensors);
+	}
+
+	SUBCASE("submit")
+	{
+		std::atomic<int> outputs_count{0};
+		auto on_done = [](Cunder_Array outputs, void *user_data) {
+			*(std::atomic<int> *)user_data += (int)outputs.length;
+			cunder_array_free(outputs);
+		};
+		for (int i = 0; i < 16; ++i)
+			CHECK(cunder_module_pool_submit(pool, model_inputs, on_done, &outputs_count) == 0);
+		cunder_module_pool_free(pool); // drains the queue
+		pool = nullptr;
+		CHECK(outputs_count == 16 * 3);
+	}
+
+	SUBCASE("forward from a worker")
+	{
+		struct Nested_Forward
+		{
+			Cunder_ModulePool *pool;
+			Cunder_Array inputs;
+			std::atomic<int> outputs_count{-1};
+		} nested;
+		nested.pool = pool;
+		nested.inputs = model_inputs;
+		auto on_done = [](Cunder_Array outputs, void *user_data) {
+			Nested_Forward *nested = (Nested_Forward *)user_data;
+			cunder_array_free(outputs);
+			Cunder_Array nested_outputs = cunder_module_pool_forward(nested->pool, nested->inputs); // fails instead of deadlocking
+			nested->outputs_count = (int)nested_outputs.length;
+			cunder_array_free(nested_outputs);
+		};
+		REQUIRE(cunder_module_pool_submit(pool, model_inputs, on_done, &nested) == 0);
+		cunder_module_pool_free(pool);
+		pool = nullptr;
+		CHECK(nested.outputs_count == 0);
+		CHECK(cunder_module_pool_workers_count(nullptr) == 0);
+	}
+
+	cunder_array_free(model_inputs);
+	cunder_module_pool_free(pool);
+	cunder_module_free(cunder_module);
+}
+
+// cunder_module pool asynchronous forward
+TEST_CASE("[Module] pool async")
+{
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model_2_input_3_output.pt");
+	cunder_module_eval(cunder_module);
+	Cunder_ModulePool *pool = cunder_module_pool_create(cunder_module, 1, 8);
+
+	Cunder_Array model_inputs = model_2_input_3_output_inputs();
+
+	Cunder_Future *future = cunder_module_pool_forward_async(pool, model_inputs);
+	REQUIRE(future != nullptr);
+	CHECK(cunder_future_wait(future, 10000) == 0);
+	CHECK(cunder_future_poll(future));
+
+	// completed futures call back right away
+	int callback_calls = 0;
+	cunder_future_set_callback(
+		future, [](Cunder_Future *, void *user_data) { ++*(int *)user_data; }, &callback_calls);
+	CHECK(callback_calls == 1);
+
+	Cunder_Array output_tensors = cunder_future_get(future);
+	CHECK(output_tensors.length == 3);
+	cunder_array_free(output_tensors);
+	cunder_future_free(future);
+	CHECK(cunder_future_poll(nullptr) == false);
+
+	SUBCASE("pending future")
+	{
+		// the single worker is held by a blocking submission, the future stays pending until it is released
+		std::atomic<bool> release{false};
+		auto block = [](Cunder_Array outputs, void *user_data) {
+			cunder_array_free(outputs);
+			while (((std::atomic<bool> *)user_data)->load() == false)
+				std::this_thread::yield();
+		};
+		REQUIRE(cunder_module_pool_submit(pool, model_inputs, block, &release) == 0);
+		Cunder_Future *pending = cunder_module_pool_forward_async(pool, model_inputs);
+		REQUIRE(pending != nullptr);
+
+		struct Callback_Result
+		{
+			std::atomic<int> calls{0};
+			std::atomic<size_t> outputs_count{0};
+		} result;
+		cunder_future_set_callback(
+			pending,
+			[](Cunder_Future *future, void *user_data) {
+				Callback_Result *result = (Callback_Result *)user_data;
+				Cunder_Array outputs = cunder_future_get(future);
+				result->outputs_count = outputs.length;
+				cunder_array_free(outputs);
+				result->calls += 1;
+			},
+			&result);
+		CHECK(result.calls == 0);
+		CHECK(cunder_future_poll(pending) == false);
+
+#ifdef __linux__
+		int event_fd = cunder_future_eventfd(pending);
+		REQUIRE(event_fd >= 0);
+		CHECK(cunder_future_eventfd(pending) == event_fd);
+		uint64_t events = 0;
+		CHECK(read(event_fd, &events, sizeof(events)) == -1); // not readable yet
+#endif // __linux__
+
+		release = true;
+		CHECK(cunder_future_wait(pending, 10000) == 0);
+		while (result.calls == 0)
+			std::this_thread::yield();
+		CHECK(result.calls == 1);
+		CHECK(result.outputs_count == 3);
+
+#ifdef __linux__
+		CHECK(read(event_fd, &events, sizeof(events)) == (ssize_t)sizeof(events));
+		CHECK(events == 1);
+#endif // __linux__
+		cunder_future_free(pending);
+	}
+
+	cunder_array_free(model_inputs);
+	cunder_module_pool_free(pool);
+	cunder_module_free(cunder_module);
+}
+
+// cunder_module forward into caller buffers
+TEST_CASE("[Module] forward into")
+{
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model_2_input_3_output.pt");
+	cunder_module_eval(cunder_module);
+
+	Cunder_Array model_inputs = model_2_input_3_output_inputs();
+
+	float output_0[15];
+	double output_2[30];
+	Cunder_OutputBindings *bindings = cunder_output_bindings_create(3);
+	cunder_output_bindings_set(bindings, 0, output_0, sizeof(output_0), Cunder_Float32);
+	cunder_output_bindings_set(bindings, 2, output_2, sizeof(output_2), Cunder_Float64);
+
+	CHECK(cunder_module_forward_into(cunder_module, model_inputs, bindings) == 0);
+	CHECK(cunder_output_bindings_ndim(bindings, 1) == -1); // unbound
+	int64_t ndim = cunder_output_bindings_ndim(bindings, 0);
+	REQUIRE(ndim > 0);
+	std::vector<int64_t> shape(ndim);
+	cunder_output_bindings_shape(bindings, 0, shape.data());
+	CHECK(shape[0] == 5);
+
+	// the bound buffers hold the outputs of a regular forward
+	Cunder_Array expected_outputs = cunder_module_forward(cunder_module, model_inputs);
+	REQUIRE(expected_outputs.length == 3);
+	Cunder_Tensor *expected_0 = cunder_tensor_array_get(expected_outputs, 0);
+	Cunder_Tensor *expected_2 = cunder_tensor_array_get(expected_outputs, 2);
+	REQUIRE(cunder_tensor_numel(expected_0) <= 15);
+	REQUIRE(cunder_tensor_numel(expected_2) <= 30);
+	for (int64_t e = 0; e < cunder_tensor_numel(expected_0); ++e)
+		CHECK(output_0[e] == doctest::Approx(cunder_tensor_accessor_f32(expected_0)[e]));
+	for (int64_t e = 0; e < cunder_tensor_numel(expected_2); ++e)
+		CHECK(output_2[e] == doctest::Approx(cunder_tensor_accessor_f32(expected_2)[e]));
+	cunder_array_free(expected_outputs);
+
+	// too small buffers are rejected before any output is written
+	std::fill(std::begin(output_0), std::end(output_0), -1.0f);
+	cunder_output_bindings_set(bindings, 2, output_2, sizeof(double), Cunder_Float64);
+	CHECK(cunder_module_forward_into(cunder_module, model_inputs, bindings) == -1);
+	CHECK(std::all_of(std::begin(output_0), std::end(output_0), [](float value) { return value == -1.0f; }));
+	CHECK(cunder_output_bindings_ndim(bindings, 0) == ndim); // still describes the previous write
+
+	cunder_output_bindings_free(bindings);
+	cunder_array_free(model_inputs);
+	cunder_module_free(cunder_module);
+}
+
+// handles are recycled through the slab freelists
+TEST_CASE("[Tensor] handles")
+{
+	int shape[] = {2, 2};
+	SUBCASE("single")
+	{
+		for (int i = 0; i < 1000; ++i)
+		{
+			Cunder_Tensor *cunder_tensor = cunder_tensor_zeros(2, shape, Cunder_Float32);
+			CHECK(cunder_tensor != nullptr);
+			CHECK(cunder_tensor_free(cunder_tensor) == 0);
+		}
+	}
+
+	SUBCASE("arrays")
+	{
+		size_t lengths[] = {0, 1, 3, 16, 17, 100};
+		for (size_t length : lengths)
+		{
+			Cunder_Array tensors_array = cunder_tensor_allocate(length);
+			for (size_t i = 0; i < length; ++i)
+			{
+				Cunder_Tensor *cunder_tensor = cunder_tensor_ones(2, shape, Cunder_Int32);
+				cunder_tensor_array_set(tensors_array, i, cunder_tensor);
+				cunder_tensor_array_set(tensors_array, i, cunder_tensor); // the moved from handle is empty
+				cunder_tensor_free(cunder_tensor);
+			}
+			CHECK(tensors_array.length == length);
+			CHECK(cunder_array_free(tensors_array) == 0);
+		}
+	}
+}
+
+// built-in caching allocator
+TEST_CASE("[Allocator] caching")
+{
+	Cunder_CachingAllocatorConfig config = cunder_caching_allocator_default_config();
+	config.max_cached_bytes = 64 * 1024 * 1024;
+	Cunder_Allocator *allocator = cunder_set_caching_cpu_allocator(&config);
+
+	int shapes[][2] = {{3, 5}, {256, 256}, {1024, 1024}};
+	for (int i = 0; i < 10; ++i)
+	{
+		for (auto &shape : shapes)
+		{
+			Cunder_Tensor *cunder_tensor = cunder_tensor_ones(2, shape, Cunder_Float32);
+			CHECK(cunder_tensor_numel(cunder_tensor) == shape[0] * shape[1]);
+			CHECK(cunder_tensor_accessor_f32(cunder_tensor)[shape[0] * shape[1] - 1] == 1.0f);
+			cunder_tensor_free(cunder_tensor);
+		}
+	}
+
+	// a freed block is cached and handed back to the next allocation of its size
+	int shape[] = {256, 256};
+	Cunder_Tensor *first = cunder_tensor_ones(2, shape, Cunder_Float32);
+	const float *first_data = cunder_tensor_accessor_f32(first);
+	cunder_tensor_free(first);
+	Cunder_AllocatorStats stats;
+	cunder_allocator_stats(allocator, &stats);
+	CHECK(stats.cached_bytes >= 256 * 256 * 4);
+	Cunder_Tensor *second = cunder_tensor_ones(2, shape, Cunder_Float32);
+	CHECK(cunder_tensor_accessor_f32(second) == first_data);
+	cunder_tensor_free(second);
+
+	cunder_allocator_empty_cache(allocator);
+	cunder_allocator_stats(allocator, &stats);
+	CHECK(stats.cached_bytes == 0);
+	cunder_allocator_free(allocator);
+}
+
+// allocators freed out of installation order
+TEST_CASE("[Allocator] chain")
+{
+	Cunder_Allocator *first = cunder_set_caching_cpu_allocator(nullptr);
+	Cunder_Allocator *second = cunder_set_caching_cpu_allocator(nullptr);
+	cunder_allocator_free(first); // not the current one, `second` now restores the allocator `first` replaced
+
+	int shape[] = {16, 16};
+	Cunder_Tensor *cunder_tensor = cunder_tensor_ones(2, shape, Cunder_Float32);
+	Cunder_AllocatorStats stats;
+	cunder_allocator_stats(second, &stats);
+	CHECK(stats.allocations_count == 1);
+	cunder_tensor_free(cunder_tensor);
+	cunder_allocator_free(second);
+
+	// allocations go to the original allocator again
+	cunder_tensor = cunder_tensor_ones(2, shape, Cunder_Float32);
+	CHECK(cunder_tensor_accessor_f32(cunder_tensor)[255] == 1.0f);
+	cunder_tensor_free(cunder_tensor);
+}
+
+// tensors released after cunder_allocator_free()
+TEST_CASE("[Allocator] tensors outliving the allocator")
+{
+	static std::atomic<int> frees_count{0};
+	frees_count = 0;
+	int shape[] = {64, 64};
+
+	SUBCASE("callbacks")
+	{
+		auto allocate = [](size_t nbytes, uint8_t alignment) -> void * {
+#ifdef _WIN32
+			return _aligned_malloc(nbytes, alignment);
+#else
+			void *data = nullptr;
+			return posix_memalign(&data, alignment, nbytes) == 0 ? data : nullptr;
+#endif // _WIN32
+		};
+		auto deallocate = [](void *data) {
+#ifdef _WIN32
+			_aligned_free(data);
+#else
+			free(data);
+#endif // _WIN32
+			frees_count += 1;
+		};
+		Cunder_Allocator *allocator = cunder_set_cpu_allocator(allocate, deallocate);
+		Cunder_Tensor *cunder_tensor = cunder_tensor_ones(2, shape, Cunder_Float32);
+		cunder_allocator_free(allocator); // the tensor keeps it alive
+		CHECK(frees_count == 0);
+		CHECK(cunder_tensor_accessor_f32(cunder_tensor)[64 * 64 - 1] == 1.0f);
+		cunder_tensor_free(cunder_tensor);
+		CHECK(frees_count == 1);
+	}
+
+	SUBCASE("caching")
+	{
+		Cunder_Allocator *allocator = cunder_set_caching_cpu_allocator(nullptr);
+		Cunder_Tensor *cunder_tensor = cunder_tensor_ones(2, shape, Cunder_Float32);
+		cunder_allocator_free(allocator);
+		CHECK(cunder_tensor_accessor_f32(cunder_tensor)[64 * 64 - 1] == 1.0f);
+		cunder_tensor_free(cunder_tensor);
+	}
+}
+
+// allocator accounting
+TEST_CASE("[Allocator] stats")
+{
+	Cunder_Allocator *allocator = cunder_set_caching_cpu_allocator(nullptr);
+
+	Cunder_AllocatorStats stats;
+	CHECK(cunder_allocator_stats(allocator, &stats) == 0);
+	CHECK(stats.current_bytes == 0);
+
+	int shape[] = {256, 256};
+	Cunder_Tensor *cunder_tensor = cunder_tensor_zeros(2, shape, Cunder_Float32);
+	cunder_allocator_stats(allocator, &stats);
+	CHECK(stats.current_bytes == 256 * 256 * 4);
+	CHECK(stats.allocations_count == 1);
+	CHECK(stats.histogram[18] == 1); // 2^18 bytes
+	cunder_tensor_free(cunder_tensor);
+
+	cunder_allocator_stats(allocator, &stats);
+	CHECK(stats.current_bytes == 0);
+	CHECK(stats.peak_bytes == 256 * 256 * 4);
+	CHECK(stats.deallocations_count == 1);
+
+	SUBCASE("forward scope")
+	{
+		Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model_2_input_3_output.pt");
+		cunder_module_eval(cunder_module);
+
+		Cunder_Array model_inputs = model_2_input_3_output_inputs();
+
+		Cunder_MemoryScope scope;
+		REQUIRE(cunder_allocator_scope_begin(allocator, &scope) == 0);
+		Cunder_MemoryScope nested_scope;
+		CHECK(cunder_allocator_scope_begin(allocator, &nested_scope) == -1); // would reset the peak of `scope`
+		CHECK(cunder_allocator_scope_end(allocator, &nested_scope) == -1);
+		Cunder_Array output_tensors = cunder_module_forward(cunder_module, model_inputs);
+		REQUIRE(cunder_allocator_scope_end(allocator, &scope) == 0);
+		CHECK(cunder_allocator_scope_end(allocator, &scope) == -1);
+		CHECK(scope.allocations_count > 0);
+		CHECK(scope.peak_bytes >= (15 + 12 + 30) * 4); // the outputs are alive at the end of the scope
+		CHECK(scope.end_bytes >= scope.start_bytes);
+
+		cunder_array_free(output_tensors);
+		cunder_array_free(model_inputs);
+		cunder_module_free(cunder_module);
+	}
+
+	cunder_allocator_free(allocator);
+}
+
+// load modules from memory
+TEST_CASE("[Module] load buffer and mmap")
+{
+	SUBCASE("buffer")
+	{
+		FILE *file = fopen(CUNDER_DATA_DIR "/model_2_input_3_output.pt", "rb");
+		REQUIRE(file != nullptr);
+		std::vector<char> archive;
+		char chunk[4096];
+		size_t read_count;
+		while ((read_count = fread(chunk, 1, sizeof(chunk), file)) > 0)
+			archive.insert(archive.end(), chunk, chunk + read_count);
+		fclose(file);
+
+		Cunder_Module *cunder_module = cunder_module_load_buffer(archive.data(), archive.size());
+		REQUIRE(cunder_module != nullptr);
+		CHECK(cunder_module_input_num(cunder_module) == 2);
+		cunder_module_free(cunder_module);
+
+		CHECK(cunder_module_load_buffer(archive.data(), 16) == nullptr); // truncated archive
+	}
+
+	SUBCASE("mmap")
+	{
+		Cunder_Module *cunder_module = cunder_module_load_mmap(CUNDER_DATA_DIR "/model_2_input_3_output.pt");
+		REQUIRE(cunder_module != nullptr);
+		CHECK(cunder_module_input_num(cunder_module) == 2);
+		cunder_module_free(cunder_module);
+
+		CHECK(cunder_module_load_mmap(CUNDER_DATA_DIR "/missing.pt") == nullptr);
+		CHECK(std::string(cunder_module_last_error()).find("missing.pt") != std::string::npos);
+	}
+
+	SUBCASE("errors")
+	{
+		// reported through cunder_module_last_error(), cleared by the next successful load
+		CHECK(cunder_module_load(CUNDER_DATA_DIR "/missing.pt") == nullptr);
+		CHECK(std::string(cunder_module_last_error()).empty() == false);
+		char garbage[64] = {};
+		CHECK(cunder_module_load_buffer(garbage, sizeof(garbage)) == nullptr);
+		CHECK(std::string(cunder_module_last_error()).empty() == false);
+
+		Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model.pt");
+		REQUIRE(cunder_module != nullptr);
+		CHECK(std::string(cunder_module_last_error()).empty());
+		cunder_module_free(cunder_module);
+	}
+}
+
+// freeze and optimize modules for inference
+TEST_CASE("[Module] freeze")
+{
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model_2_input_3_output.pt");
+	cunder_module_eval(cunder_module);
+
+	Cunder_Array model_inputs = model_2_input_3_output_inputs();
+
+	bool optimize_flags[] = {false, true};
+	for (bool optimize : optimize_flags)
+	{
+		Cunder_Module *frozen_module = cunder_module_freeze(cunder_module, optimize);
+		REQUIRE(frozen_module != nullptr);
+
+		Cunder_Array output_tensors = cunder_module_forward(cunder_module, model_inputs);
+		Cunder_Array frozen_output_tensors = cunder_module_forward(frozen_module, model_inputs);
+		REQUIRE(frozen_output_tensors.length == output_tensors.length);
+		for (size_t i = 0; i < output_tensors.length; ++i)
+		{
+			Cunder_Tensor *output = cunder_tensor_array_get(output_tensors, i);
+			Cunder_Tensor *frozen_output = cunder_tensor_array_get(frozen_output_tensors, i);
+			REQUIRE(cunder_tensor_numel(frozen_output) == cunder_tensor_numel(output));
+			for (int64_t j = 0; j < cunder_tensor_numel(output); ++j)
+				CHECK(cunder_tensor_accessor_f32(frozen_output)[j] == doctest::Approx(cunder_tensor_accessor_f32(output)[j]));
+		}
+
+		cunder_array_free(output_tensors);
+		cunder_array_free(frozen_output_tensors);
+		cunder_module_free(frozen_module);
+	}
+
+	cunder_array_free(model_inputs);
+	cunder_module_free(cunder_module);
+}
+
+// operator profiler
+TEST_CASE("[Profiler] forward")
+{
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model_2_input_3_output.pt");
+	cunder_module_eval(cunder_module);
+
+	Cunder_Array model_inputs = model_2_input_3_output_inputs();
+
+	Cunder_Profiler *profiler = cunder_profiler_start(true, true);
+	REQUIRE(profiler != nullptr);
+	for (int i = 0; i < 3; ++i)
+		cunder_array_free(cunder_module_forward(cunder_module, model_inputs));
+	CHECK(cunder_profiler_stop(profiler) == 0);
+
+	REQUIRE(cunder_profiler_ops_count(profiler) > 0);
+	Cunder_ProfilerOp previous_op, op;
+	cunder_profiler_op(profiler, 0, &previous_op);
+	for (size_t i = 1; i < cunder_profiler_ops_count(profiler); ++i)
+	{
+		CHECK(cunder_profiler_op(profiler, i, &op) == 0);
+		CHECK(op.calls_count > 0);
+		CHECK(op.self_cpu_time_us <= previous_op.self_cpu_time_us);
+		previous_op = op;
+	}
+	CHECK(cunder_profiler_op(profiler, cunder_profiler_ops_count(profiler), &op) == -1);
+
+	CHECK(cunder_profiler_export_chrome_trace(profiler, "cunder_profile.json") == 0);
+	CHECK(cunder_profiler_write_summary(profiler, "cunder_profile.txt") == 0);
+	remove("cunder_profile.json");
+	remove("cunder_profile.txt");
+	cunder_profiler_free(profiler);
+
+	cunder_array_free(model_inputs);
+	cunder_module_free(cunder_module);
+}
+
+// thread pools sizes and cpu affinity
+TEST_CASE("[Threads] control")
+{
+	int threads_count = cunder_get_num_threads();
+	CHECK(threads_count >= 1);
+	CHECK(cunder_set_num_threads(1) == 0);
+	CHECK(cunder_get_num_threads() == 1);
+	CHECK(cunder_set_num_threads(0) == -1);
+	CHECK(cunder_set_num_threads(threads_count) == 0);
+	CHECK(cunder_get_num_interop_threads() >= 1);
+
+	int invalid_cpu = -1;
+	CHECK(cunder_set_thread_affinity(&invalid_cpu, 1) == -1);
+	CHECK(cunder_set_thread_affinity(nullptr, 0) == -1);
+
+#ifdef __linux__
+	// the later tests run unpinned: the original cpus are put back on the test and intra-op threads
+	std::vector<int> original_cpus(1024);
+	int original_count = cunder_get_thread_affinity(original_cpus.data(), original_cpus.size());
+	REQUIRE(original_count > 0);
+	original_cpus.resize((size_t)std::min(original_count, (int)original_cpus.size()));
+
+	std::vector<int> cpus(1024);
+	int cpus_count = cunder_numa_node_cpus(0, cpus.data(), cpus.size());
+	if (cpus_count > 0)
+	{
+		// a single cpu of the node, one the test thread may already run on
+		cpus.resize((size_t)std::min(cpus_count, (int)cpus.size()));
+		auto allowed = std::find_first_of(cpus.begin(), cpus.end(), original_cpus.begin(), original_cpus.end());
+		int cpu = allowed != cpus.end() ? *allowed : cpus[0];
+		CHECK(cunder_set_thread_affinity(&cpu, 1) == 0);
+		int pinned_cpu = -1;
+		CHECK(cunder_get_thread_affinity(&pinned_cpu, 1) == 1);
+		CHECK(pinned_cpu == cpu);
+		CHECK(cunder_set_intra_op_affinity(cpus.data(), cpus.size()) == 0);
+
+		Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model.pt");
+		REQUIRE(cunder_module != nullptr);
+		Cunder_ModulePool *pool = cunder_module_pool_create(cunder_module, 2, 8);
+		REQUIRE(pool != nullptr);
+		CHECK(cunder_module_pool_set_affinity(pool, cpus.data(), cpus.size()) == 0);
+		cunder_module_pool_free(pool);
+		cunder_module_free(cunder_module);
+
+		CHECK(cunder_set_intra_op_affinity(original_cpus.data(), original_cpus.size()) == 0);
+		CHECK(cunder_set_thread_affinity(original_cpus.data(), original_cpus.size()) == 0);
+		CHECK(cunder_get_thread_affinity(nullptr, 0) == original_count);
+	}
+#endif // __linux__
+}
+
+// inference session forward
+TEST_CASE("[Session] forward")
+{
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model_2_input_3_output.pt");
+	cunder_module_eval(cunder_module);
+
+	Cunder_Array model_inputs = model_2_input_3_output_inputs();
+
+	Cunder_Array expected_outputs = cunder_module_forward(cunder_module, model_inputs);
+
+	SUBCASE("inference mode")
+	{
+		Cunder_Session *session = cunder_session_create(nullptr);
+		for (int i = 0; i < 3; ++i)
+		{
+			Cunder_Array output_tensors = cunder_session_forward(session, cunder_module, model_inputs);
+			REQUIRE(output_tensors.length == 3);
+			for (size_t o = 0; o < 3; ++o)
+			{
+				Cunder_Tensor *output = cunder_tensor_array_get(output_tensors, o);
+				Cunder_Tensor *expected = cunder_tensor_array_get(expected_outputs, o);
+				REQUIRE(cunder_tensor_numel(output) == cunder_tensor_numel(expected));
+				for (int64_t e = 0; e < cunder_tensor_numel(output); ++e)
+					CHECK(cunder_tensor_accessor_f32(output)[e] == doctest::Approx(cunder_tensor_accessor_f32(expected)[e]));
+			}
+			cunder_array_free(output_tensors);
+		}
+		cunder_session_free(session);
+	}
+
+	SUBCASE("no grad, no graph optimizations")
+	{
+		int threads_count = cunder_get_num_threads();
+		bool profiling_executor = cunder_get_jit_profiling_executor();
+		Cunder_SessionOptions options = cunder_session_default_options();
+		options.inference_mode = false;
+		options.grad_enabled = false;
+		options.jit_optimize = false;
+		Cunder_Session *session = cunder_session_create(&options);
+		Cunder_Array output_tensors = cunder_session_forward(session, cunder_module, model_inputs);
+		CHECK(output_tensors.length == 3);
+		// sessions leave the process settings alone
+		CHECK(cunder_get_num_threads() == threads_count);
+		CHECK(cunder_get_jit_profiling_executor() == profiling_executor);
+		cunder_array_free(output_tensors);
+		cunder_session_free(session);
+	}
+
+	cunder_array_free(expected_outputs);
+	cunder_array_free(model_inputs);
+	cunder_module_free(cunder_module);
+}
+
+// N-d and strided tensors over caller memory
+TEST_CASE("[Tensor] strided data")
+{
+	SUBCASE("4d")
+	{
+		int shape[] = {/* batch */ 2, /* channel */ 3, /* height */ 4, /* width */ 5};
+		Cunder_Tensor *cunder_tensor = cunder_tensor_zeros(4, shape, Cunder_Float32);
+		CHECK(cunder_tensor_ndim(cunder_tensor) == 4);
+		CHECK(cunder_tensor_numel(cunder_tensor) == 120);
+		cunder_tensor_free(cunder_tensor);
+	}
+
+	SUBCASE("sub region")
+	{
+		// 2x2 region starting at row 1, column 1 of a 4x4 buffer
+		float buffer[16];
+		for (int i = 0; i < 16; ++i)
+			buffer[i] = (float)i;
+		int64_t shape[] = {2, 2};
+		int64_t strides[] = {4, 1};
+		Cunder_Tensor *cunder_tensor = cunder_tensor_from_data_strided(2, shape, strides, buffer + 5, Cunder_Float32, nullptr, nullptr);
+		REQUIRE(cunder_tensor != nullptr);
+		CHECK(cunder_tensor_is_contiguous(cunder_tensor) == false);
+		int64_t out_strides[2];
+		cunder_tensor_strides(cunder_tensor, out_strides);
+		CHECK(out_strides[0] == 4);
+		CHECK(out_strides[1] == 1);
+
+		Cunder_Tensor *cloned = cunder_tensor_clone(cunder_tensor);
+		const float *values = cunder_tensor_accessor_f32(cloned);
+		CHECK(values[0] == 5);
+		CHECK(values[1] == 6);
+		CHECK(values[2] == 9);
+		CHECK(values[3] == 10);
+		cunder_tensor_free(cloned);
+		cunder_tensor_free(cunder_tensor);
+	}
+
+	SUBCASE("deleter")
+	{
+		int deleted_count = 0;
+		auto deleter = [](void *data, void *context) {
+			delete[] (float *)data;
+			*(int *)context += 1;
+		};
+		int64_t shape[] = {2, 3, 4, 5, 6};
+		Cunder_Tensor *cunder_tensor = cunder_tensor_from_data_strided(5, shape, nullptr, new float[720](), Cunder_Float32, deleter, &deleted_count);
+		REQUIRE(cunder_tensor != nullptr);
+		CHECK(cunder_tensor_is_contiguous(cunder_tensor));
+
+		// cunder_tensor_array_set() moves the tensor into the array, the memory lives until the array is freed
+		Cunder_Array tensors_array = cunder_tensor_allocate(1);
+		cunder_tensor_array_set(tensors_array, 0, cunder_tensor);
+		cunder_tensor_free(cunder_tensor);
+		CHECK(deleted_count == 0);
+		cunder_array_free(tensors_array);
+		CHECK(deleted_count == 1);
+
+		int64_t invalid_strides[] = {-1, 1, 1, 1, 1};
+		CHECK(cunder_tensor_from_data_strided(5, shape, invalid_strides, nullptr, Cunder_Float32, nullptr, nullptr) == nullptr);
+	}
+}
+
+// float16/bfloat16 conversion into preallocated tensors
+TEST_CASE("[Tensor] half precision")
+{
+	int shape[] = {2, 2};
+	float float_data[] = {1.0f, 0.5f, -2.0f, 0.0f};
+	uint8_t byte_data[] = {0, 1, 2, 255};
+
+	SUBCASE("float16")
+	{
+		Cunder_Tensor *cunder_tensor = cunder_tensor_empty(2, shape, Cunder_Float16);
+		CHECK(cunder_tensor_type(cunder_tensor) == Cunder_Float16);
+
+		CHECK(cunder_tensor_convert_from(cunder_tensor, float_data, Cunder_Float32) == 0);
+		const uint16_t *bits = cunder_tensor_accessor_f16(cunder_tensor);
+		CHECK(bits[0] == 0x3C00);
+		CHECK(bits[1] == 0x3800);
+		CHECK(bits[2] == 0xC000);
+		CHECK(bits[3] == 0x0000);
+
+		CHECK(cunder_tensor_convert_from(cunder_tensor, byte_data, Cunder_Uint8) == 0);
+		CHECK(bits[1] == 0x3C00);
+		CHECK(bits[3] == 0x5BF8);
+		cunder_tensor_free(cunder_tensor);
+	}
+
+	SUBCASE("bfloat16")
+	{
+		Cunder_Tensor *cunder_tensor = cunder_tensor_empty(2, shape, Cunder_BFloat16);
+		CHECK(cunder_tensor_type(cunder_tensor) == Cunder_BFloat16);
+
+		CHECK(cunder_tensor_convert_from(cunder_tensor, float_data, Cunder_Float32) == 0);
+		const uint16_t *bits = cunder_tensor_accessor_bf16(cunder_tensor);
+		CHECK(bits[0] == 0x3F80);
+		CHECK(bits[1] == 0x3F00);
+		CHECK(bits[2] == 0xC000);
+
+		CHECK(cunder_tensor_convert_from(cunder_tensor, byte_data, Cunder_Uint8) == 0);
+		CHECK(bits[3] == 0x437F);
+
+		// back to float32
+		cunder_tensor_to(cunder_tensor, Cunder_Float32);
+		CHECK(cunder_tensor_accessor_f32(cunder_tensor)[3] == 255.0f);
+		cunder_tensor_free(cunder_tensor);
+	}
+}
+
+// dynamic int8 quantization
+TEST_CASE("[Module] quantize dynamic")
+{
+	// a single Linear(2, 4) layer
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/linear.pt");
+	REQUIRE(cunder_module != nullptr);
+	cunder_module_eval(cunder_module);
+
+	float tensor_data[] = {1, 9, 1, 3, 2, 5};
+	int tensor_data_shape[] = {/* batch */ 3, /* channel */ 2};
+	Cunder_Array model_inputs = cunder_tensor_allocate(1);
+	Cunder_Tensor *cunder_data_tensor = cunder_tensor_from_data(2, tensor_data_shape, tensor_data, Cunder_Float32);
+	cunder_tensor_array_set(model_inputs, 0, cunder_data_tensor);
+
+	Cunder_QuantizationReport report;
+	Cunder_Module *quantized_module = cunder_module_quantize_dynamic(cunder_module, &model_inputs, &report);
+	REQUIRE(quantized_module != nullptr);
+	CHECK(report.quantized_layers_count == 1);
+	CHECK(report.compared_elements_count == 3 * 4);
+	CHECK(report.max_abs_error < 0.25);
+	CHECK(report.mean_abs_error <= report.max_abs_error);
+	CHECK(report.relative_error < 0.05);
+
+	Cunder_Array output_tensors = cunder_module_forward(cunder_module, model_inputs);
+	Cunder_Array quantized_output_tensors = cunder_module_forward(quantized_module, model_inputs);
+	REQUIRE(quantized_output_tensors.length == 1);
+	REQUIRE(output_tensors.length == 1);
+	Cunder_Tensor *output = cunder_tensor_array_get(output_tensors, 0);
+	Cunder_Tensor *quantized_output = cunder_tensor_array_get(quantized_output_tensors, 0);
+	REQUIRE(cunder_tensor_numel(quantized_output) == cunder_tensor_numel(output));
+	for (int64_t e = 0; e < cunder_tensor_numel(output); ++e)
+		CHECK(std::abs(cunder_tensor_accessor_f32(quantized_output)[e] - cunder_tensor_accessor_f32(output)[e]) <= report.max_abs_error + 1e-6);
+
+	SUBCASE("no linear layer")
+	{
+		Cunder_Module *plain_module = cunder_module_load(CUNDER_DATA_DIR "/identity.pt");
+		REQUIRE(plain_module != nullptr);
+		Cunder_QuantizationReport plain_report;
+		Cunder_Module *plain_quantized = cunder_module_quantize_dynamic(plain_module, &model_inputs, &plain_report);
+		REQUIRE(plain_quantized != nullptr);
+		CHECK(plain_report.quantized_layers_count == 0);
+		CHECK(plain_report.max_abs_error == 0);
+		cunder_module_free(plain_quantized);
+		cunder_module_free(plain_module);
+	}
+
+	cunder_array_free(output_tensors);
+	cunder_array_free(quantized_output_tensors);
+	cunder_module_free(quantized_module);
+	cunder_array_free(model_inputs);
+	cunder_tensor_free(cunder_data_tensor);
+	cunder_module_free(cunder_module);
+}
+
+// u8 HWC image to normalized float tensors
+TEST_CASE("[Tensor] image u8")
+{
+	// 2x20 image, 3 channels, rows padded to 64 bytes
+	const int height = 2, width = 20, channels = 3;
+	uint8_t image[height * 64];
+	for (int y = 0; y < height; ++y)
+		for (int i = 0; i < width * channels; ++i)
+			image[y * 64 + i] = (uint8_t)(y * 100 + i);
+	float mean[] = {10, 20, 30};
+	float stddev[] = {2, 4, 8};
+	auto expected = [&](int y, int x, int c) { return ((float)image[y * 64 + x * channels + c] - mean[c]) / stddev[c]; };
+
+	SUBCASE("channels first")
+	{
+		Cunder_Tensor *cunder_tensor = cunder_tensor_from_image_u8(image, height, width, channels, 64, mean, stddev, Cunder_ChannelsFirst);
+		REQUIRE(cunder_tensor != nullptr);
+		int64_t shape[4];
+		cunder_tensor_shape(cunder_tensor, shape);
+		CHECK(shape[1] == channels);
+		CHECK(shape[2] == height);
+		CHECK(shape[3] == width);
+		const float *values = cunder_tensor_accessor_f32(cunder_tensor);
+		for (int c = 0; c < channels; ++c)
+			for (int y = 0; y < height; ++y)
+				for (int x = 0; x < width; ++x)
+					CHECK(values[(c * height + y) * width + x] == doctest::Approx(expected(y, x, c)));
+		cunder_tensor_free(cunder_tensor);
+	}
+
+	SUBCASE("channels last batch")
+	{
+		int shape[] = {2, height, width, channels};
+		Cunder_Tensor *batch = cunder_tensor_zeros(4, shape, Cunder_Float32);
+		CHECK(cunder_tensor_image_u8_into(batch, 1, image, height, width, channels, 64, mean, stddev, Cunder_ChannelsLast) == 0);
+		const float *values = cunder_tensor_accessor_f32(batch);
+		CHECK(values[0] == 0.0f); // first image untouched
+		const float *second = values + height * width * channels;
+		for (int y = 0; y < height; ++y)
+			for (int x = 0; x < width; ++x)
+				for (int c = 0; c < channels; ++c)
+					CHECK(second[(y * width + x) * channels + c] == doctest::Approx(expected(y, x, c)));
+
+		// layout mismatch and out of range batch index
+		CHECK(cunder_tensor_image_u8_into(batch, 0, image, height, width, channels, 64, mean, stddev, Cunder_ChannelsFirst) == -1);
+		CHECK(cunder_tensor_image_u8_into(batch, 2, image, height, width, channels, 64, mean, stddev, Cunder_ChannelsLast) == -1);
+		cunder_tensor_free(batch);
+	}
+}
+
+// export tensors into caller buffers
+TEST_CASE("[Tensor] export")
+{
+	float buffer[12];
+	for (int i = 0; i < 12; ++i)
+		buffer[i] = (float)i;
+
+	SUBCASE("contiguous view")
+	{
+		int shape[] = {3, 4};
+		Cunder_Tensor *cunder_tensor = cunder_tensor_from_data(2, shape, buffer, Cunder_Float32);
+		CHECK(cunder_tensor_data_view(cunder_tensor, Cunder_Float32) == buffer);
+		CHECK(cunder_tensor_data_view(cunder_tensor, Cunder_Float64) == nullptr);
+
+		// exporting into the memory the tensor already uses is a no-op
+		CHECK(cunder_tensor_export(cunder_tensor, buffer, sizeof(buffer), Cunder_Float32, nullptr) == 0);
+
+		double converted[12];
+		CHECK(cunder_tensor_export(cunder_tensor, converted, sizeof(converted), Cunder_Float64, nullptr) == 0);
+		CHECK(converted[11] == 11.0);
+		CHECK(cunder_tensor_export(cunder_tensor, converted, sizeof(converted) - 1, Cunder_Float64, nullptr) == -1);
+		cunder_tensor_free(cunder_tensor);
+	}
+
+	SUBCASE("non contiguous")
+	{
+		// transposed view of a 3x4 buffer
+		int64_t shape[] = {4, 3};
+		int64_t strides[] = {1, 4};
+		Cunder_Tensor *cunder_tensor = cunder_tensor_from_data_strided(2, shape, strides, buffer, Cunder_Float32, nullptr, nullptr);
+		CHECK(cunder_tensor_data_view(cunder_tensor, Cunder_Float32) == nullptr);
+
+		int32_t exported[12];
+		CHECK(cunder_tensor_export(cunder_tensor, exported, sizeof(exported), Cunder_Int32, nullptr) == 0);
+		CHECK(exported[0] == 0);
+		CHECK(exported[1] == 4);
+		CHECK(exported[2] == 8);
+		CHECK(exported[3] == 1);
+
+		// column major destination
+		int64_t destination_strides[] = {1, 4};
+		CHECK(cunder_tensor_export(cunder_tensor, exported, sizeof(exported), Cunder_Int32, destination_strides) == 0);
+		for (int i = 0; i < 12; ++i)
+			CHECK(exported[i] == i);
+		cunder_tensor_free(cunder_tensor);
+	}
+}
+
+// post-processing operators on output tensors
+TEST_CASE("[Tensor] post-processing")
+{
+	float logits_data[] = {1, 3, 2, 0, /* row 2 */ 5, 4, -1, 6};
+	int logits_shape[] = {2, 4};
+	Cunder_Tensor *logits = cunder_tensor_from_data(2, logits_shape, logits_data, Cunder_Float32);
+
+	SUBCASE("softmax")
+	{
+		Cunder_Tensor *probabilities = cunder_tensor_softmax(logits, 1);
+		int64_t dims[] = {1};
+		Cunder_Tensor *sums = cunder_tensor_reduce(probabilities, Cunder_Sum, dims, 1, false);
+		CHECK(cunder_tensor_numel(sums) == 2);
+		CHECK(cunder_tensor_accessor_f32(sums)[0] == doctest::Approx(1.0f));
+		CHECK(cunder_tensor_accessor_f32(sums)[1] == doctest::Approx(1.0f));
+		cunder_tensor_free(sums);
+		cunder_tensor_free(probabilities);
+	}
+
+	SUBCASE("argmax and top-k")
+	{
+		Cunder_Tensor *classes = cunder_tensor_argmax(logits, 1, false);
+		CHECK(cunder_tensor_type(classes) == Cunder_Int64);
+		CHECK(cunder_tensor_accessor_i64(classes)[0] == 1);
+		CHECK(cunder_tensor_accessor_i64(classes)[1] == 3);
+		cunder_tensor_free(classes);
+
+		Cunder_Tensor *values = nullptr;
+		Cunder_Tensor *indices = nullptr;
+		CHECK(cunder_tensor_topk(logits, 2, 1, true, &values, &indices) == 0);
+		CHECK(cunder_tensor_accessor_f32(values)[0] == 3.0f);
+		CHECK(cunder_tensor_accessor_f32(values)[1] == 2.0f);
+		CHECK(cunder_tensor_accessor_i64(indices)[2] == 3);
+		CHECK(cunder_tensor_accessor_i64(indices)[3] == 0);
+		cunder_tensor_free(values);
+		cunder_tensor_free(indices);
+		CHECK(cunder_tensor_topk(logits, 5, 1, true, &values, &indices) == -1);
+	}
+
+	SUBCASE("elementwise and masks")
+	{
+		Cunder_Tensor *scaled = cunder_tensor_binary_scalar(logits, 0.5, Cunder_Mul);
+		CHECK(cunder_tensor_type(scaled) == Cunder_Float32);
+		Cunder_Tensor *shifted = cunder_tensor_binary(scaled, logits, Cunder_Add);
+		CHECK(cunder_tensor_accessor_f32(shifted)[1] == 4.5f);
+		Cunder_Tensor *activated = cunder_tensor_unary(logits, Cunder_Relu);
+		CHECK(cunder_tensor_accessor_f32(activated)[6] == 0.0f);
+
+		Cunder_Tensor *mask = cunder_tensor_compare_scalar(logits, 2.5, Cunder_Greater);
+		CHECK(cunder_tensor_type(mask) == Cunder_Bool);
+		Cunder_Tensor *count = cunder_tensor_reduce(mask, Cunder_Sum, nullptr, 0, false);
+		CHECK(cunder_tensor_accessor_i64(count)[0] == 4);
+		Cunder_Tensor *maximum = cunder_tensor_reduce(logits, Cunder_Max, nullptr, 0, false);
+		CHECK(cunder_tensor_accessor_f32(maximum)[0] == 6.0f);
+
+		cunder_tensor_free(maximum);
+		cunder_tensor_free(count);
+		cunder_tensor_free(mask);
+		cunder_tensor_free(activated);
+		cunder_tensor_free(shifted);
+		cunder_tensor_free(scaled);
+	}
+
+	cunder_tensor_free(logits);
+}
+
+// result cache in front of cunder_module forward
+TEST_CASE("[Module] result cache")
+{
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model.pt");
+	cunder_module_eval(cunder_module);
+	Cunder_ResultCache *cache = cunder_result_cache_create(cunder_module, 1024 * 1024);
+
+	float tensor_data[] = {1, 9, 1, 3, 2, 5};
+	int tensor_data_shape[] = {/* batch */ 3, /* channel */ 2};
+	Cunder_Array model_inputs = cunder_tensor_allocate(1);
+	Cunder_Tensor *cunder_data_tensor = cunder_tensor_from_data(2, tensor_data_shape, tensor_data, Cunder_Float32);
+	cunder_tensor_array_set(model_inputs, 0, cunder_data_tensor);
+
+	Cunder_Array first_outputs = cunder_result_cache_forward(cache, model_inputs);
+	Cunder_Array second_outputs = cunder_result_cache_forward(cache, model_inputs);
+	REQUIRE(first_outputs.length == second_outputs.length);
+	CHECK(cunder_tensor_accessor_f32(&first_outputs.data[0]) == cunder_tensor_accessor_f32(&second_outputs.data[0]));
+
+	// same shape, other bytes
+	tensor_data[0] = 2;
+	Cunder_Array third_outputs = cunder_result_cache_forward(cache, model_inputs);
+
+	Cunder_ResultCacheStats stats;
+	CHECK(cunder_result_cache_stats(cache, &stats) == 0);
+	CHECK(stats.hits == 1);
+	CHECK(stats.misses == 2);
+	CHECK(stats.entries_count == 2);
+	CHECK(stats.bytes > 0);
+
+	cunder_result_cache_clear(cache);
+	cunder_result_cache_stats(cache, &stats);
+	CHECK(stats.entries_count == 0);
+	CHECK(stats.bytes == 0);
+
+	cunder_array_free(first_outputs);
+	cunder_array_free(second_outputs);
+	cunder_array_free(third_outputs);
+	cunder_array_free(model_inputs);
+	cunder_tensor_free(cunder_data_tensor);
+	cunder_result_cache_free(cache);
+	cunder_module_free(cunder_module);
+}
+
+TEST_CASE("[Module] result cache outputs aliasing the inputs")
+{
+	// the identity model returns its input, the cached output must not follow the caller buffer
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/identity.pt");
+	REQUIRE(cunder_module != nullptr);
+	Cunder_ResultCache *cache = cunder_result_cache_create(cunder_module, 1024 * 1024);
+
+	float tensor_data[] = {1, 9, 1, 3, 2, 5};
+	int tensor_data_shape[] = {/* batch */ 3, /* channel */ 2};
+	Cunder_Array model_inputs = cunder_tensor_allocate(1);
+	Cunder_Tensor *cunder_data_tensor = cunder_tensor_from_data(2, tensor_data_shape, tensor_data, Cunder_Float32);
+	cunder_tensor_array_set(model_inputs, 0, cunder_data_tensor);
+
+	Cunder_Array first_outputs = cunder_result_cache_forward(cache, model_inputs);
+	REQUIRE(first_outputs.length == 1);
+	cunder_array_free(first_outputs);
+
+	tensor_data[0] = 7;
+	Cunder_Array second_outputs = cunder_result_cache_forward(cache, model_inputs);
+	REQUIRE(second_outputs.length == 1);
+	CHECK(cunder_tensor_accessor_f32(&second_outputs.data[0])[0] == 7);
+
+	// back to the first bytes: a hit, with the values of the first forward
+	tensor_data[0] = 1;
+	Cunder_Array third_outputs = cunder_result_cache_forward(cache, model_inputs);
+	REQUIRE(third_outputs.length == 1);
+	tensor_data[0] = 8;
+	CHECK(cunder_tensor_accessor_f32(&third_outputs.data[0])[0] == 1);
+
+	Cunder_ResultCacheStats stats;
+	cunder_result_cache_stats(cache, &stats);
+	CHECK(stats.hits == 1);
+	CHECK(stats.misses == 2);
+
+	cunder_array_free(second_outputs);
+	cunder_array_free(third_outputs);
+	cunder_array_free(model_inputs);
+	cunder_tensor_free(cunder_data_tensor);
+	cunder_result_cache_free(cache);
+	cunder_module_free(cunder_module);
+}
+
+// model registry, lazy loading and eviction
+TEST_CASE("[Module] registry")
+{
+	Cunder_ModelRegistry *registry = cunder_model_registry_create(0);
+	CHECK(cunder_model_registry_register(registry, "model", 1, CUNDER_DATA_DIR "/model.pt") == 0);
+	CHECK(cunder_model_registry_register(registry, "model", 2, CUNDER_DATA_DIR "/model.pt") == 0);
+	CHECK(cunder_model_registry_register(registry, "model", 2, CUNDER_DATA_DIR "/model.pt") == -1);
+	CHECK(cunder_model_registry_register(registry, "model_2_input_3_output", 1, CUNDER_DATA_DIR "/model_2_input_3_output.pt") == 0);
+	CHECK(cunder_model_registry_register(registry, "linear", 1, CUNDER_DATA_DIR "/linear.pt") == 0);
+
+	Cunder_ModelRegistryStats stats;
+	cunder_model_registry_stats(registry, &stats);
+	CHECK(stats.models_count == 4);
+	CHECK(stats.resident_count == 0); // nothing loaded yet
+
+	SUBCASE("acquire and release")
+	{
+		Cunder_Module *latest = cunder_model_registry_acquire(registry, "model", -1);
+		REQUIRE(latest != nullptr);
+		CHECK(cunder_model_registry_acquire(registry, "model", 2) == latest);
+		CHECK(cunder_model_registry_footprint(registry, "model", 1) == -1);
+		CHECK(cunder_model_registry_unregister(registry, "model", 2) == -1); // in use
+
+		CHECK(cunder_model_registry_release(registry, latest) == 0);
+		CHECK(cunder_model_registry_release(registry, latest) == 0);
+		CHECK(cunder_model_registry_release(registry, latest) == -1);
+		CHECK(cunder_model_registry_unregister(registry, "model", 2) == 0);
+		CHECK(cunder_model_registry_acquire(registry, "unknown", 1) == nullptr);
+
+		Cunder_Module *linear = cunder_model_registry_acquire(registry, "linear", 1);
+		REQUIRE(linear != nullptr);
+		CHECK(cunder_model_registry_footprint(registry, "linear", 1) == (8 + 4) * 4); // weight and bias
+		CHECK(cunder_model_registry_release(registry, linear) == 0);
+	}
+
+	SUBCASE("eviction")
+	{
+		// room for a single linear.pt (48 bytes of parameters), loading a second one evicts the first
+		cunder_model_registry_free(registry);
+		registry = cunder_model_registry_create(64);
+		cunder_model_registry_register(registry, "linear", 1, CUNDER_DATA_DIR "/linear.pt");
+		cunder_model_registry_register(registry, "linear", 2, CUNDER_DATA_DIR "/linear.pt");
+
+		Cunder_Module *first = cunder_model_registry_acquire(registry, "linear", 1);
+		REQUIRE(first != nullptr);
+		int64_t footprint = cunder_model_registry_footprint(registry, "linear", 1);
+		CHECK(footprint > 0);
+		CHECK(footprint <= 64);
+		cunder_model_registry_release(registry, first);
+		cunder_model_registry_stats(registry, &stats);
+		CHECK(stats.resident_count == 1); // within the budget
+		CHECK(stats.evictions_count == 0);
+
+		Cunder_Module *second = cunder_model_registry_acquire(registry, "linear", 2);
+		REQUIRE(second != nullptr);
+		cunder_model_registry_stats(registry, &stats);
+		CHECK(stats.loads_count == 2);
+		CHECK(stats.evictions_count == 1);
+		CHECK(stats.resident_count == 1);
+		CHECK(cunder_model_registry_footprint(registry, "linear", 1) == -1); // evicted
+
+		// referenced modules stay resident even over the budget
+		Cunder_Module *reloaded = cunder_model_registry_acquire(registry, "linear", 1);
+		REQUIRE(reloaded != nullptr);
+		cunder_model_registry_stats(registry, &stats);
+		CHECK(stats.resident_count == 2);
+		CHECK(stats.evictions_count == 1);
+		cunder_model_registry_release(registry, reloaded);
+		cunder_model_registry_release(registry, second);
+	}
+
+	cunder_model_registry_free(registry);
+}
+
+// replicas sharing the parameters storage
+TEST_CASE("[Module] replicate")
+{
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model.pt");
+	cunder_module_eval(cunder_module);
+
+	float tensor_data[] = {1, 9, 1, 3, 2, 5};
+	int tensor_data_shape[] = {/* batch */ 3, /* channel */ 2};
+	Cunder_Array model_inputs = cunder_tensor_allocate(1);
+	Cunder_Tensor *cunder_data_tensor = cunder_tensor_from_data(2, tensor_data_shape, tensor_data, Cunder_Float32);
+	cunder_tensor_array_set(model_inputs, 0, cunder_data_tensor);
+	Cunder_Array expected_outputs = cunder_module_forward(cunder_module, model_inputs);
+
+	Cunder_Module *replicas[4];
+	REQUIRE(cunder_module_replicate_n(cunder_module, 4, replicas) == 0);
+	cunder_module_free(cunder_module); // the replicas keep the shared tensors alive
+
+	std::vector<std::thread> threads;
+	std::atomic<int> matches{0};
+	for (Cunder_Module *replica : replicas)
+	{
+		threads.emplace_back([&, replica] {
+			Cunder_Array output_tensors = cunder_module_forward(replica, model_inputs);
+			const Cunder_Tensor *output = cunder_tensor_array_get(output_tensors, 0);
+			const Cunder_Tensor *expected = cunder_tensor_array_get(expected_outputs, 0);
+			bool same = cunder_tensor_numel(output) == cunder_tensor_numel(expected);
+			for (int64_t e = 0; same && e < cunder_tensor_numel(output); ++e)
+				same = cunder_tensor_accessor_f32(output)[e] == cunder_tensor_accessor_f32(expected)[e];
+			matches += same ? 1 : 0;
+			cunder_array_free(output_tensors);
+		});
+	}
+	for (std::thread &thread : threads)
+		thread.join();
+	CHECK(matches == 4);
+
+	for (Cunder_Module *replica : replicas)
+		cunder_module_free(replica);
+	cunder_array_free(expected_outputs);
+	cunder_array_free(model_inputs);
+	cunder_tensor_free(cunder_data_tensor);
+}
+
+// tensor files, save and memory mapped zero-copy load
+TEST_CASE("[Tensor] file")
+{
+	float features_data[] = {1, 9, 1, 3, 2, 5, 7, 8, 0, 4, 6, 2};
+	int features_shape[] = {3, 4};
+	Cunder_Array tensors = cunder_tensor_allocate(3);
+	Cunder_Tensor *features = cunder_tensor_from_data(2, features_shape, features_data, Cunder_Float32);
+	Cunder_Tensor *ids = cunder_tensor_range(0, 9, 1, Cunder_Int64);
+	int empty_shape[] = {0, 7};
+	Cunder_Tensor *empty = cunder_tensor_zeros(2, empty_shape, Cunder_Float64);
+	cunder_tensor_array_set(tensors, 0, features);
+	cunder_tensor_array_set(tensors, 1, ids);
+	cunder_tensor_array_set(tensors, 2, empty);
+	const char *names[] = {"features", "ids", "empty"};
+	REQUIRE(cunder_tensor_file_save("cunder_tensors.bin", names, tensors) == 0);
+
+	Cunder_TensorFile *file = cunder_tensor_file_open("cunder_tensors.bin");
+	REQUIRE(file != nullptr);
+	CHECK(cunder_tensor_file_count(file) == 3);
+	CHECK(std::string(cunder_tensor_file_name(file, 1)) == "ids");
+	CHECK(cunder_tensor_file_get(file, "missing") == nullptr);
+	CHECK(cunder_tensor_file_count(nullptr) == 0);
+	CHECK(cunder_tensor_file_name(nullptr, 0) == nullptr);
+
+	Cunder_Tensor *loaded_features = cunder_tensor_file_get(file, "features");
+	Cunder_Tensor *loaded_ids = cunder_tensor_file_get_at(file, 1);
+	Cunder_Tensor *loaded_empty = cunder_tensor_file_get(file, "empty");
+	cunder_tensor_file_close(file); // the views keep the mapping alive
+
+	REQUIRE(loaded_features != nullptr);
+	CHECK(cunder_tensor_type(loaded_features) == Cunder_Float32);
+	CHECK(cunder_tensor_dim_size(loaded_features, 1) == 4);
+	CHECK((uintptr_t)cunder_tensor_accessor_f32(loaded_features) % 64 == 0);
+	for (int i = 0; i < 12; ++i)
+		CHECK(cunder_tensor_accessor_f32(loaded_features)[i] == features_data[i]);
+	CHECK(cunder_tensor_numel(loaded_ids) == 10);
+	CHECK(cunder_tensor_accessor_i64(loaded_ids)[9] == 9);
+	CHECK(cunder_tensor_numel(loaded_empty) == 0);
+
+	cunder_tensor_free(loaded_features);
+	cunder_tensor_free(loaded_ids);
+	cunder_tensor_free(loaded_empty);
+	cunder_array_free(tensors);
+	cunder_tensor_free(features);
+	cunder_tensor_free(ids);
+	cunder_tensor_free(empty);
+	remove("cunder_tensors.bin");
+
+	// not a tensor file
+	CHECK(cunder_tensor_file_open(CUNDER_DATA_DIR "/model.pt") == nullptr);
+}
+
+// preprocess, forward and postprocess pipeline
+TEST_CASE("[Module] pipeline")
+{
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model.pt");
+	cunder_module_eval(cunder_module);
+
+	struct Pipeline_Counts
+	{
+		std::atomic<int> completed{0};
+		std::atomic<int> failed{0};
+		std::atomic<bool> blocked{false}; // postprocess waits while set
+	} counts;
+
+	// a request is a {batch, channel} float buffer, NULL fails the preprocess
+	auto preprocess = [](void *request, Cunder_Array *out_inputs, void *) -> int {
+		if (request == nullptr)
+			return -1;
+		int shape[] = {/* batch */ 3, /* channel */ 2};
+		*out_inputs = cunder_tensor_allocate(1);
+		Cunder_Tensor *input = cunder_tensor_from_data(2, shape, request, Cunder_Float32);
+		cunder_tensor_array_set(*out_inputs, 0, input);
+		cunder_tensor_free(input);
+		return 0;
+	};
+	auto postprocess = [](void *, Cunder_Array outputs, void *user_data) {
+		Pipeline_Counts *counts = (Pipeline_Counts *)user_data;
+		while (counts->blocked)
+			std::this_thread::yield();
+		if (outputs.data == nullptr)
+		{
+			counts->failed += 1;
+			return;
+		}
+		counts->completed += 1;
+		cunder_array_free(outputs);
+	};
+	float tensor_data[] = {1, 9, 1, 3, 2, 5};
+
+	SUBCASE("requests")
+	{
+		Cunder_Pipeline *pipeline = cunder_pipeline_create(cunder_module, preprocess, postprocess, &counts, 4);
+		REQUIRE(pipeline != nullptr);
+
+		for (int i = 0; i < 32; ++i)
+			CHECK(cunder_pipeline_submit(pipeline, tensor_data) == 0);
+		CHECK(cunder_pipeline_submit(pipeline, nullptr) == 0);
+		CHECK(cunder_pipeline_flush(pipeline) == 0);
+		CHECK(counts.completed == 32);
+		CHECK(counts.failed == 1);
+
+		int submitted = 0;
+		for (int i = 0; i < 8; ++i)
+			submitted += cunder_pipeline_try_submit(pipeline, tensor_data) == 0 ? 1 : 0;
+		CHECK(cunder_pipeline_free(pipeline) == 0); // drains the stages
+		CHECK(counts.completed == 32 + submitted);
+	}
+
+	SUBCASE("backpressure")
+	{
+		// a blocked postprocess fills every queue of capacity 1, then the submissions stop being accepted
+		counts.blocked = true;
+		Cunder_Pipeline *pipeline = cunder_pipeline_create(cunder_module, preprocess, postprocess, &counts, 1);
+		REQUIRE(pipeline != nullptr);
+
+		int accepted = 0;
+		int rejected_in_a_row = 0;
+		for (int i = 0; i < 1000 && rejected_in_a_row < 50; ++i)
+		{
+			int result = cunder_pipeline_try_submit(pipeline, tensor_data);
+			REQUIRE(result >= 0);
+			accepted += result == 0 ? 1 : 0;
+			rejected_in_a_row = result == 1 ? rejected_in_a_row + 1 : 0;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1)); // let the stages pull what they can
+		}
+		CHECK(rejected_in_a_row == 50);
+		CHECK(accepted > 0);
+		CHECK(accepted < 16); // bounded by the queues and the three stages
+		CHECK(cunder_pipeline_try_submit(pipeline, tensor_data) == 1);
+
+		std::atomic<bool> submitted{false};
+		int submit_result = -1;
+		std::thread producer([&] {
+			submit_result = cunder_pipeline_submit(pipeline, tensor_data);
+			submitted = true;
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		CHECK(submitted == false); // blocked on the full queue
+
+		counts.blocked = false;
+		producer.join();
+		CHECK(submit_result == 0);
+		CHECK(cunder_pipeline_flush(pipeline) == 0);
+		CHECK(counts.completed == accepted + 1);
+		CHECK(cunder_pipeline_free(pipeline) == 0);
+	}
+
+	cunder_module_free(cunder_module);
+}
+
+TEST_CASE("[Module] scheduler")
+{
+	Cunder_Module *cunder_module = cunder_module_load(CUNDER_DATA_DIR "/model.pt");
+	REQUIRE(cunder_module != nullptr);
+	cunder_module_eval(cunder_module);
+
+	float tensor_data[] = {1, 9, 1, 3, 2, 5};
+	int shape[] = {/* batch */ 3, /* channel */ 2};
+	Cunder_Tensor *input = cunder_tensor_from_data(2, shape, tensor_data, Cunder_Float32);
+	Cunder_Array model_input = {input, 1};
+
+	// a window long enough that only full batches, deadlines or the scheduler free dispatch
+	Cunder_SchedulerConfig held_config = cunder_scheduler_default_config();
+	held_config.target_p99_ms = 60000;
+	held_config.max_window_ms = 40000;
+	const double far_deadline_ms = 60000;
+
+	SUBCASE("batched forward")
+	{
+		Cunder_SchedulerConfig config = cunder_scheduler_default_config();
+		config.target_p99_ms = 1000;
+		config.max_batch_size = 4;
+		config.queue_capacity = 16;
+		Cunder_Scheduler *scheduler = cunder_scheduler_create(cunder_module, &config);
+		REQUIRE(scheduler != nullptr);
+
+		std::vector<Cunder_Future *> futures;
+		for (int i = 0; i < 10; ++i)
+		{
+			Cunder_Future *future = cunder_scheduler_submit(scheduler, model_input, /* deadline_ms */ 0, /* priority */ i % 2);
+			REQUIRE(future != nullptr);
+			futures.push_back(future);
+		}
+
+		Cunder_Array expected = cunder_module_forward(cunder_module, model_input);
+		for (Cunder_Future *future : futures)
+		{
+			Cunder_Array outputs = cunder_future_get(future);
+			REQUIRE(outputs.length == 1);
+			CHECK(cunder_tensor_numel(&outputs.data[0]) == cunder_tensor_numel(&expected.data[0]));
+			const float *values = cunder_tensor_accessor_f32(&outputs.data[0]);
+			const float *expected_values = cunder_tensor_accessor_f32(&expected.data[0]);
+			for (int64_t i = 0; i < cunder_tensor_numel(&expected.data[0]); ++i)
+				CHECK(values[i] == doctest::Approx(expected_values[i]));
+			cunder_array_free(outputs);
+			cunder_future_free(future);
+		}
+		cunder_array_free(expected);
+
+		Cunder_SchedulerStats stats;
+		CHECK(cunder_scheduler_stats(scheduler, &stats) == 0);
+		CHECK(stats.requests_count == 10);
+		CHECK(stats.batches_count >= 3); // at most 4 requests per batch
+		CHECK(stats.rejected_count == 0);
+		CHECK(stats.pending_count == 0);
+		CHECK(stats.window_ms <= config.max_window_ms);
+
+		CHECK(cunder_scheduler_submit(nullptr, model_input, 0, 0) == nullptr);
+		CHECK(cunder_scheduler_free(scheduler) == 0);
+	}
+
+	SUBCASE("priority order")
+	{
+		// the 4th request fills the batch, which completes by priority
+		Cunder_SchedulerConfig config = held_config;
+		config.max_batch_size = 4;
+		Cunder_Scheduler *scheduler = cunder_scheduler_create(cunder_module, &config);
+		REQUIRE(scheduler != nullptr);
+
+		struct Completion
+		{
+			std::vector<int> *order;
+			int priority;
+		};
+		std::vector<int> order;
+		Completion completions[] = {{&order, 0}, {&order, 2}, {&order, 1}};
+		std::vector<Cunder_Future *> futures;
+		for (Completion &completion : completions)
+		{
+			Cunder_Future *future = cunder_scheduler_submit(scheduler, model_input, far_deadline_ms, completion.priority);
+			REQUIRE(future != nullptr);
+			cunder_future_set_callback(
+				future,
+				[](Cunder_Future *, void *user_data) {
+					Completion *completion = (Completion *)user_data;
+					completion->order->push_back(completion->priority);
+				},
+				&completion);
+			futures.push_back(future);
+		}
+		Cunder_Future *last = cunder_scheduler_submit(scheduler, model_input, far_deadline_ms, /* priority */ -1);
+		REQUIRE(last != nullptr);
+		CHECK(cunder_future_wait(last, 10000) == 0); // completed after the 3 others
+
+		CHECK((order == std::vector<int>{2, 1, 0}));
+		Cunder_SchedulerStats stats;
+		cunder_scheduler_stats(scheduler, &stats);
+		CHECK(stats.batches_count == 1);
+
+		for (Cunder_Future *future : futures)
+			cunder_future_free(future);
+		cunder_future_free(last);
+		CHECK(cunder_scheduler_free(scheduler) == 0);
+	}
+
+	SUBCASE("earliest deadline dispatch")
+	{
+		// the urgent request has the lower priority, its deadline still dispatches the batch before the window ends
+		Cunder_Scheduler *scheduler = cunder_scheduler_create(cunder_module, &held_config);
+		REQUIRE(scheduler != nullptr);
+
+		Cunder_Future *relaxed = cunder_scheduler_submit(scheduler, model_input, far_deadline_ms, /* priority */ 1);
+		Cunder_Future *urgent = cunder_scheduler_submit(scheduler, model_input, /* deadline_ms */ 20, /* priority */ 0);
+		REQUIRE(relaxed != nullptr);
+		REQUIRE(urgent != nullptr);
+		CHECK(cunder_future_wait(urgent, 5000) == 0);
+
+		Cunder_Array outputs = cunder_future_get(urgent);
+		CHECK(outputs.length == 1);
+		cunder_array_free(outputs);
+		cunder_future_free(urgent);
+		cunder_future_free(relaxed);
+		CHECK(cunder_scheduler_free(scheduler) == 0);
+	}
+
+	SUBCASE("drop expired")
+	{
+		Cunder_SchedulerConfig config = held_config;
+		config.drop_expired = true;
+		Cunder_Scheduler *scheduler = cunder_scheduler_create(cunder_module, &config);
+		REQUIRE(scheduler != nullptr);
+
+		// expired long before the dispatcher can pop it
+		Cunder_Future *future = cunder_scheduler_submit(scheduler, model_input, /* deadline_ms */ 1e-6, 0);
+		REQUIRE(future != nullptr);
+		Cunder_Array outputs = cunder_future_get(future);
+		CHECK(outputs.data == nullptr);
+		CHECK(outputs.length == 0);
+
+		Cunder_SchedulerStats stats;
+		cunder_scheduler_stats(scheduler, &stats);
+		CHECK(stats.dropped_count == 1);
+		CHECK(stats.deadline_misses_count == 1);
+		CHECK(stats.batches_count == 0);
+
+		cunder_future_free(future);
+		CHECK(cunder_scheduler_free(scheduler) == 0);
+	}
+
+	SUBCASE("queue capacity")
+	{
+		Cunder_SchedulerConfig config = held_config;
+		config.queue_capacity = 2;
+		Cunder_Scheduler *scheduler = cunder_scheduler_create(cunder_module, &config);
+		REQUIRE(scheduler != nullptr);
+
+		Cunder_Future *first = cunder_scheduler_submit(scheduler, model_input, far_deadline_ms, 0);
+		Cunder_Future *second = cunder_scheduler_submit(scheduler, model_input, far_deadline_ms, 0);
+		REQUIRE(first != nullptr);
+		REQUIRE(second != nullptr);
+		CHECK(cunder_scheduler_submit(scheduler, model_input, far_deadline_ms, 0) == nullptr);
+
+		Cunder_SchedulerStats stats;
+		cunder_scheduler_stats(scheduler, &stats);
+		CHECK(stats.requests_count == 2);
+		CHECK(stats.rejected_count == 1);
+		CHECK(stats.pending_count == 2);
+
+		CHECK(cunder_scheduler_free(scheduler) == 0); // dispatches the pending requests
+		for (Cunder_Future *future : {first, second})
+		{
+			Cunder_Array outputs = cunder_future_get(future);
+			CHECK(outputs.length == 1);
+			cunder_array_free(outputs);
+			cunder_future_free(future);
+		}
+	}
+
+	SUBCASE("requests that don't batch")
+	{
+		// {3, 2} and {1, 3} inputs can't be concatenated, the identity model forwards them one by one
+		Cunder_Module *identity_module = cunder_module_load(CUNDER_DATA_DIR "/identity.pt");
+		REQUIRE(identity_module != nullptr);
+		Cunder_SchedulerConfig config = held_config;
+		config.max_batch_size = 2;
+		Cunder_Scheduler *scheduler = cunder_scheduler_create(identity_module, &config);
+		REQUIRE(scheduler != nullptr);
+
+		float other_data[] = {4, 5, 6};
+		int other_shape[] = {/* batch */ 1, /* channel */ 3};
+		Cunder_Tensor *other_input = cunder_tensor_from_data(2, other_shape, other_data, Cunder_Float32);
+		Cunder_Array other_model_input = {other_input, 1};
+
+		Cunder_Future *first = cunder_scheduler_submit(scheduler, model_input, far_deadline_ms, 0);
+		Cunder_Future *second = cunder_scheduler_submit(scheduler, other_model_input, far_deadline_ms, 0);
+		REQUIRE(first != nullptr);
+		REQUIRE(second != nullptr);
+
+		Cunder_Array first_outputs = cunder_future_get(first);
+		Cunder_Array second_outputs = cunder_future_get(second);
+		REQUIRE(first_outputs.length == 1);
+		REQUIRE(second_outputs.length == 1);
+		CHECK(cunder_tensor_numel(&first_outputs.data[0]) == 6);
+		CHECK(cunder_tensor_numel(&second_outputs.data[0]) == 3);
+		CHECK(cunder_tensor_accessor_f32(&second_outputs.data[0])[2] == 6);
+
+		cunder_array_free(first_outputs);
+		cunder_array_free(second_outputs);
+		cunder_future_free(first);
+		cunder_future_free(second);
+		CHECK(cunder_scheduler_free(scheduler) == 0);
+		cunder_tensor_free(other_input);
+		cunder_module_free(identity_module);
+	}
+
+	cunder_tensor_free(input);
+	cunder_module_free(cunder_module);
+}